@@ -3,13 +3,17 @@
 CC=cc
 CFLAGS="-std=c99 -Wall -D_GNU_SOURCE"
 SRC="src/*.c"
+# everything except the platform entry point and what needs a GPU
+CORE=$(ls src/*.c | grep -v -e "src/main.c" -e "src/render.c" -e "src/hud.c")
 LFLAGS=""
+# jterm.ti compiled, programs in the terminal find it here
+TERMINFO_DIR="$(pwd)/terminfo"
 
 OS=$(uname)
 if [ $OS = "Linux" ]; then
     LFLAGS="-lX11 -lXi -lXcursor -lGL -ldl -lpthread -lm"
 elif [ $OS = "Darwin" ]; then
-    SRC="src/sokol_mac.m"
+    SRC="src/sokol_mac.m src/render.c src/hud.c $CORE"
     echo "Building $OS..."
     LFLAGS="-framework Cocoa -framework QuartzCore -framework Metal -framework MetalKit -lobjc"
 else
@@ -17,6 +21,40 @@ else
     exit 1
 fi
 
+# Compile jterm.ti and point the build at it. Optional: without tic, or
+# if it fails, the child gets TERM=dumb and the build goes on.
+terminfo() {
+    if command -v tic >/dev/null && tic -x -o "$TERMINFO_DIR" jterm.ti; then
+        CFLAGS="$CFLAGS -DJTERM_TERMINFO=\"$TERMINFO_DIR\""
+    else
+        echo "no terminfo entry compiled, programs will see TERM=dumb"
+    fi
+}
+
 set -xe
-$CC $CFLAGS $SRC -o jterm $LFLAGS
+case "${1:-jterm}" in
+jterm)
+    terminfo
+    $CC $CFLAGS $SRC -o jterm $LFLAGS
+    ;;
+bench)
+    # headless, only needs the core
+    $CC $CFLAGS -O2 -Isrc tools/bench.c $CORE -o jterm-bench -lpthread -lm
+    ;;
+test)
+    # parser resumability: the same grid however the output is split.
+    # Exits non-zero on a mismatch, times nothing.
+    $CC $CFLAGS -O2 -Isrc tools/bench.c $CORE -o jterm-bench -lpthread -lm
+    ./jterm-bench --verify
+    ;;
+headless)
+    # no window and no GPU, for machines without a display
+    terminfo
+    $CC $CFLAGS -O2 -Isrc tools/headless.c $CORE -o jterm-headless -lpthread -lm
+    ;;
+*)
+    echo "usage: $0 [jterm|bench|test|headless]"
+    exit 1
+    ;;
+esac
 
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cells.h"
+
+void cells_init(JTermCells *c) {
+    memset(c, 0, sizeof(*c));
+}
+
+void cells_free(JTermCells *c) {
+    free(c->cells);
+    free(c->changed);
+    c->cells = NULL;
+    c->changed = NULL;
+    c->w = c->h = 0;
+}
+
+static JTermCell blank_cell(const JTermLook *look) {
+    return (JTermCell){
+        .glyph = ' ',
+        .fg = {look->fg[0], look->fg[1], look->fg[2]},
+        .attrs = look->attrs,
+        .bg = {look->bg[0], look->bg[1], look->bg[2]},
+    };
+}
+
+static void convert(const JTermStyles *styles, JTermCell *out,
+                    const uint *text, const JTermStyle *style, uint len,
+                    uint w) {
+    // styles come in runs, look each one up once
+    JTermStyle last = STYLE_DEFAULT;
+    JTermCell cell = blank_cell(styles_look(styles, last));
+
+    for (uint x = 0; x < len; x++) {
+        if (style[x] != last) {
+            last = style[x];
+            cell = blank_cell(styles_look(styles, last));
+        }
+        out[x] = cell;
+        // the debugtext fonts only cover 8 bit codes
+        out[x].glyph = text[x] > GLYPH_MAX ? '?' : text[x];
+    }
+    cell = blank_cell(styles_look(styles, STYLE_DEFAULT));
+    for (uint x = len; x < w; x++)
+        out[x] = cell;
+}
+
+/* Runs of screen rows whose storage rows follow each other, the grid's
+ * below shown rows of scrollback. False if there are too many. */
+static bool find_spans(JTermCells *c, JTermGrid *g, uint shown) {
+    c->nspans = 0;
+    for (uint y = shown; y < g->h; y++) {
+        uint row = grid_index(g, y - shown);
+        JTermSpan *s = &c->span[c->nspans ? c->nspans - 1 : 0];
+        if (c->nspans && s->row + s->rows == row) {
+            s->rows++;
+            continue;
+        }
+        if (c->nspans == CELLS_MAX_SPANS)
+            return false;
+        c->span[c->nspans++] = (JTermSpan){.row = row, .rows = 1, .y = y};
+    }
+    if (shown)
+        c->span[c->nspans++] = (JTermSpan){.row = g->h, .rows = shown};
+    return true;
+}
+
+bool cells_update(JTermCells *c, JTerm *t, ulong view) {
+    JTermGrid *g = &t->grid;
+    bool changed = false;
+
+    if (c->w != g->w || c->h != g->h) {
+        free(c->cells);
+        free(c->changed);
+        // grid rows, then as many scrollback rows
+        c->cells = malloc(sizeof(JTermCell) * g->w * g->h * 2);
+        c->changed = calloc(g->h * 2, 1);
+        if (!c->cells || !c->changed) {
+            ERROR("cells: out of memory");
+        }
+        c->w = g->w;
+        c->h = g->h;
+        // every row is dirty after a resize, scrollback is rebuilt below
+        c->view = 0;
+    }
+
+    /* Rotations pile up breaks between runs. Past a few, one full redraw
+     * is cheaper than a draw call per run in every frame. */
+    ulong shown = MIN(view, g->h), history = scrollback_lines(&t->scrollback);
+    if (!find_spans(c, g, shown)) {
+        grid_straighten(g);
+        find_spans(c, g, shown);
+    }
+
+    c->rebuilt = c->reused = 0;
+    for (uint row = 0; row < g->h; row++) {
+        if (!(g->row_flags[row] & ROW_DIRTY)) {
+            c->reused++;
+            continue;
+        }
+        convert(&t->styles, &c->cells[row * g->w], &g->text[row * g->w],
+                &g->style[row * g->w], g->row_end[row], g->w);
+        g->row_flags[row] &= ~ROW_DIRTY;
+        c->changed[row] = 1;
+        c->rebuilt++;
+        changed = true;
+    }
+
+    /* Lines above the screen, only when scrolled back. New output shifts
+     * what a view shows, so they follow the history length too. */
+    if (shown && (view != c->view || history != c->history)) {
+        for (uint y = 0; y < shown; y++) {
+            const JTermLine *line =
+                scrollback_line(&t->scrollback, view - 1 - y);
+            convert(&t->styles, &c->cells[(g->h + y) * g->w], line->text,
+                    line->style, MIN(line->len, g->w), g->w);
+            c->changed[g->h + y] = 1;
+        }
+        c->rebuilt += shown;
+        changed = true;
+    }
+    c->view = view;
+    c->history = history;
+
+    c->cursor = t->y + view < g->h;
+    c->cursor_x = t->x;
+    c->cursor_y = c->cursor ? t->y + view : 0;
+    return changed;
+}
@@ -0,0 +1,63 @@
+#ifndef CELLS_H
+#define CELLS_H
+
+#include <stddef.h>
+
+#include "common.h"
+#include "term.h"
+
+/* One instance per cell; the vertex shader expands it into a quad and
+ * works out the position from the instance index. Colours are RGB, the
+ * style table resolved them when SGR set them. */
+typedef struct {
+    uchar glyph, fg[3];
+    uchar attrs, bg[3];
+} JTermCell;
+
+// more runs of rows than this and the grid is straightened first
+#define CELLS_MAX_SPANS 16
+
+// Rows [row, row + rows) of the cells go on screen from row y down.
+typedef struct {
+    uint row, rows, y;
+} JTermSpan;
+
+/* The renderer's instance data, built on the CPU without touching the GPU
+ * so it can be benchmarked headless.
+ *
+ * First the grid in storage row order, then up to h rows of scrollback for
+ * a view scrolled into history. Only rows marked ROW_DIRTY are converted.
+ * Scrolling, in a region or not, moves rows on screen but not in storage,
+ * so instead of converting them again the spans say where each run of
+ * rows goes. */
+typedef struct {
+    JTermCell *cells;
+    uint w, h;
+    /* Per row of cells, set when the row is converted. The renderer
+     * clears them once the GPU has the rows. */
+    uchar *changed;
+
+    // what the scrollback rows were built for
+    ulong view, history;
+
+    // what the shader needs besides the cells, one draw per span
+    JTermSpan span[CELLS_MAX_SPANS + 1];
+    uint nspans;
+    uint cursor_x, cursor_y;
+    bool cursor;
+
+    // rows converted and rows left as they were, last update
+    uint rebuilt, reused;
+} JTermCells;
+
+void cells_init(JTermCells *c);
+void cells_free(JTermCells *c);
+/* Bring the cells up to date with the terminal, scrolled view lines back
+ * into history. Returns whether any cell changed. */
+bool cells_update(JTermCells *c, JTerm *t, ulong view);
+// Cells in use, the grid plus the scrollback rows on screen.
+static inline size_t cells_count(const JTermCells *c) {
+    return (size_t)c->w * (c->h + MIN(c->view, c->h));
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <time.h>
 
 typedef unsigned char  uchar;
 typedef unsigned short ushort;
@@ -18,5 +19,12 @@ typedef unsigned long  ulong;
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define CLAMP(x, lo, hi) MIN(MAX(x, lo), hi)
+
+static inline double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
 #endif
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "grid.h"
+
+static void *alloc(size_t size) {
+    void *p = malloc(size);
+    if (!p) {
+        ERROR("grid: out of memory");
+    }
+    return p;
+}
+
+static void fill(uint *text, JTermStyle *style, uint n, uint cp,
+                 JTermStyle st) {
+    uint i = 0;
+#ifdef __SSE2__
+    // 8 cells per step, the compiler won't vectorise two arrays at -O2
+    __m128i t = _mm_set1_epi32(cp), s = _mm_set1_epi16(st);
+    for (; i + 8 <= n; i += 8) {
+        _mm_storeu_si128((__m128i *)&text[i], t);
+        _mm_storeu_si128((__m128i *)&text[i + 4], t);
+        _mm_storeu_si128((__m128i *)&style[i], s);
+    }
+#endif
+    for (; i < n; i++) {
+        text[i] = cp;
+        style[i] = st;
+    }
+}
+
+void grid_init(JTermGrid *g, uint w, uint h) {
+    g->w = w;
+    g->h = h;
+    g->top = 0;
+    g->map = alloc(sizeof(uint) * h);
+    g->text = alloc(sizeof(uint) * w * h);
+    g->style = alloc(sizeof(JTermStyle) * w * h);
+    g->row_flags = alloc(h);
+    g->row_end = alloc(sizeof(uint) * h);
+
+    for (uint y = 0; y < h; y++) {
+        g->map[y] = y;
+        fill(grid_text(g, y), grid_style(g, y), w, ' ', STYLE_DEFAULT);
+        g->row_flags[y] = ROW_DIRTY;
+        g->row_end[y] = 0;
+    }
+}
+
+void grid_free(JTermGrid *g) {
+    free(g->map);
+    free(g->text);
+    free(g->style);
+    free(g->row_flags);
+    free(g->row_end);
+    g->map = NULL;
+    g->text = NULL;
+    g->style = NULL;
+    g->row_flags = NULL;
+    g->row_end = NULL;
+}
+
+void grid_resize(JTermGrid *g, uint w, uint h, uint top) {
+    JTermGrid old = *g;
+    grid_init(g, w, h);
+
+    uint rows = MIN(h, old.h - top), cols = MIN(w, old.w);
+    for (uint y = 0; y < rows; y++) {
+        memcpy(grid_text(g, y), grid_text(&old, top + y), sizeof(uint) * cols);
+        memcpy(grid_style(g, y), grid_style(&old, top + y),
+               sizeof(JTermStyle) * cols);
+        *grid_end(g, y) = MIN(*grid_end(&old, top + y), cols);
+        // with a different width the old wrap points are meaningless
+        if (w == old.w)
+            *grid_flags(g, y) |= *grid_flags(&old, top + y) & ROW_WRAPPED;
+    }
+    grid_free(&old);
+}
+
+void grid_fill(JTermGrid *g, uint y, uint x0, uint x1, uint cp,
+               JTermStyle style) {
+    uint *end = grid_end(g, y);
+
+    if (x0 >= x1)
+        return;
+    if (cp == ' ' && style == STYLE_DEFAULT) {
+        // past the end it is blank already
+        if (x1 >= *end) {
+            x1 = *end;
+            *end = MIN(*end, x0);
+        }
+    } else {
+        *end = MAX(*end, x1);
+    }
+    if (x0 < x1)
+        fill(&grid_text(g, y)[x0], &grid_style(g, y)[x0], x1 - x0, cp, style);
+    grid_touch(g, y);
+}
+
+void grid_write_ascii(JTermGrid *g, uint y, uint x, const uchar *run,
+                      uint n, JTermStyle style) {
+    uint *text = &grid_text(g, y)[x];
+    JTermStyle *st = &grid_style(g, y)[x];
+    uint i = 0;
+#ifdef __SSE2__
+    // widen 16 bytes to 16 codepoints per step, styles like fill()
+    __m128i zero = _mm_setzero_si128(), s = _mm_set1_epi16(style);
+    for (; i + 16 <= n; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)&run[i]);
+        __m128i lo = _mm_unpacklo_epi8(b, zero);
+        __m128i hi = _mm_unpackhi_epi8(b, zero);
+        _mm_storeu_si128((__m128i *)&text[i], _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *)&text[i + 4], _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *)&text[i + 8], _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *)&text[i + 12],
+                         _mm_unpackhi_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *)&st[i], s);
+        _mm_storeu_si128((__m128i *)&st[i + 8], s);
+    }
+#endif
+    for (; i < n; i++) {
+        text[i] = run[i];
+        st[i] = style;
+    }
+    *grid_end(g, y) = MAX(*grid_end(g, y), x + n);
+    grid_touch(g, y);
+}
+
+void grid_insert_cells(JTermGrid *g, uint y, uint x, uint n,
+                       JTermStyle style) {
+    uint *text = grid_text(g, y);
+    JTermStyle *st = grid_style(g, y);
+    uint *end = grid_end(g, y);
+
+    n = MIN(n, g->w - x);
+    memmove(&text[x + n], &text[x], sizeof(uint) * (g->w - x - n));
+    memmove(&st[x + n], &st[x], sizeof(JTermStyle) * (g->w - x - n));
+    if (*end > x)
+        *end = MIN(*end + n, g->w);
+    grid_fill(g, y, x, x + n, ' ', style);
+}
+
+void grid_delete_cells(JTermGrid *g, uint y, uint x, uint n,
+                       JTermStyle style) {
+    uint *text = grid_text(g, y);
+    JTermStyle *st = grid_style(g, y);
+    uint *end = grid_end(g, y);
+
+    n = MIN(n, g->w - x);
+    memmove(&text[x], &text[x + n], sizeof(uint) * (g->w - x - n));
+    memmove(&st[x], &st[x + n], sizeof(JTermStyle) * (g->w - x - n));
+    // what was at the end moved n to the left, the stale tail is filled
+    uint moved = *end > x ? MAX(*end, x + n) - n : *end;
+    grid_fill(g, y, g->w - n, g->w, ' ', style);
+    if (style == STYLE_DEFAULT)
+        *end = MIN(*end, moved);
+}
+
+// Reverse the storage rows of screen rows [y0, y1).
+static void reverse_rows(JTermGrid *g, uint y0, uint y1) {
+    while (y0 + 1 < y1) {
+        uint *a = &g->map[grid_slot(g, y0++)], *b = &g->map[grid_slot(g, --y1)];
+        uint tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
+
+/* Rotate screen rows [y0, y1) up by n, the first n rows come back in at
+ * the bottom. Three reversals, y1 - y0 index swaps in all whatever n. The
+ * rows keep their storage and their cells, so none of them is dirty. */
+static void rotate_up(JTermGrid *g, uint y0, uint y1, uint n) {
+    reverse_rows(g, y0, y0 + n);
+    reverse_rows(g, y0 + n, y1);
+    reverse_rows(g, y0, y1);
+}
+
+static void blank_rows(JTermGrid *g, uint y0, uint y1, JTermStyle style) {
+    for (uint y = y0; y < y1; y++) {
+        *grid_flags(g, y) &= ~ROW_WRAPPED;
+        grid_blank(g, y, 0, g->w, style);
+    }
+}
+
+void grid_insert_rows(JTermGrid *g, uint y, uint bottom, uint n,
+                      JTermStyle style) {
+    n = MIN(n, bottom - y);
+    // down by n is up by the rest, the rows pushed out come in at the top
+    rotate_up(g, y, bottom, bottom - y - n);
+    blank_rows(g, y, y + n, style);
+}
+
+void grid_delete_rows(JTermGrid *g, uint y, uint bottom, uint n,
+                      JTermStyle style) {
+    n = MIN(n, bottom - y);
+    rotate_up(g, y, bottom, n);
+    blank_rows(g, bottom - n, bottom, style);
+}
+
+void grid_scroll_up(JTermGrid *g, JTermStyle style) {
+    // the old top row becomes the new bottom row
+    g->top = grid_slot(g, 1);
+
+    *grid_flags(g, g->h - 1) = 0;
+    grid_blank(g, g->h - 1, 0, g->w, style);
+}
+
+void grid_straighten(JTermGrid *g) {
+    // a resize to the same size lays the rows out afresh
+    grid_resize(g, g->w, g->h, 0);
+}
@@ -0,0 +1,122 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "common.h"
+#include "style.h"
+
+// Row flags
+#define ROW_WRAPPED (1 << 0) // text continues on the next row
+#define ROW_DIRTY (1 << 1)   // changed since the renderer last looked
+
+/* Screen cells, structure-of-arrays: codepoints and styles are separate
+ * contiguous w*h arrays so a text pass doesn't drag styles through the
+ * cache and vice versa.
+ *
+ * Rows are stored circularly: screen row y is in slot (top + y) % h, so
+ * scrolling the whole screen up is bumping top and blanking one row
+ * instead of moving everything.
+ *
+ * Each slot holds the index of a storage row in map. Scrolling part of
+ * the screen, inside a scroll region or for IL/DL, rotates those indices
+ * and never copies cells. That is one index swap per row of the region
+ * rather than O(1) like bumping top, but no row is dirty for having moved.
+ * Row flags follow their storage row, and so does the renderer: it keeps
+ * its rows in storage order and draws each run of them that is
+ * consecutive on screen too, see JTermCells. */
+typedef struct {
+    uint w, h;
+    uint top;
+    uint *map;
+    uint *text;
+    JTermStyle *style;
+    uchar *row_flags;
+    /* Per storage row, cells from here on are blanks in STYLE_DEFAULT. An
+     * upper bound: blanking past it is skipped, scrollback and the
+     * renderer stop reading there. */
+    uint *row_end;
+} JTermGrid;
+
+void grid_init(JTermGrid *g, uint w, uint h);
+void grid_free(JTermGrid *g);
+/* Resize to w*h keeping rows [top, top + h) of the old contents at the
+ * top-left. */
+void grid_resize(JTermGrid *g, uint w, uint h, uint top);
+
+/* Set cells [x0, x1) of row y to cp in the given style. The edits below
+ * all work on whole spans and mark only the rows they change dirty. */
+void grid_fill(JTermGrid *g, uint y, uint x0, uint x1, uint cp,
+               JTermStyle style);
+/* Write n bytes of printable ASCII at x in row y, which has room for
+ * them. */
+void grid_write_ascii(JTermGrid *g, uint y, uint x, const uchar *run,
+                      uint n, JTermStyle style);
+// Insert n blank cells at x, the rest of the row moves right and falls off.
+void grid_insert_cells(JTermGrid *g, uint y, uint x, uint n,
+                       JTermStyle style);
+// Delete n cells at x, the rest of the row moves left and blanks follow.
+void grid_delete_cells(JTermGrid *g, uint y, uint x, uint n,
+                       JTermStyle style);
+/* Insert n blank rows at y, rows [y, bottom) move down and the ones pushed
+ * past bottom are lost. Like deleting, this rotates rows: only the n
+ * blank ones are dirty afterwards and no cells are copied. */
+void grid_insert_rows(JTermGrid *g, uint y, uint bottom, uint n,
+                      JTermStyle style);
+// Delete n rows at y, rows up to bottom move up and blank rows follow.
+void grid_delete_rows(JTermGrid *g, uint y, uint bottom, uint n,
+                      JTermStyle style);
+/* Drop the top row, everything moves up and the bottom row is blank. Only
+ * the new bottom row is marked dirty, the others keep their content and
+ * just sit one screen row higher. */
+void grid_scroll_up(JTermGrid *g, JTermStyle style);
+/* Put the storage rows back in screen order with top at 0, copying every
+ * row. They are all dirty afterwards. */
+void grid_straighten(JTermGrid *g);
+
+// Slot of screen row y.
+static inline uint grid_slot(const JTermGrid *g, uint y) {
+    uint i = g->top + y;
+    return i >= g->h ? i - g->h : i;
+}
+
+// Storage row of screen row y.
+static inline uint grid_index(const JTermGrid *g, uint y) {
+    return g->map[grid_slot(g, y)];
+}
+
+static inline uint *grid_text(JTermGrid *g, uint y) {
+    return &g->text[grid_index(g, y) * g->w];
+}
+
+static inline JTermStyle *grid_style(JTermGrid *g, uint y) {
+    return &g->style[grid_index(g, y) * g->w];
+}
+
+static inline uchar *grid_flags(JTermGrid *g, uint y) {
+    return &g->row_flags[grid_index(g, y)];
+}
+
+static inline uint *grid_end(JTermGrid *g, uint y) {
+    return &g->row_end[grid_index(g, y)];
+}
+
+static inline void grid_touch(JTermGrid *g, uint y) {
+    *grid_flags(g, y) |= ROW_DIRTY;
+}
+
+// Set cell x of row y.
+static inline void grid_set(JTermGrid *g, uint y, uint x, uint cp,
+                            JTermStyle style) {
+    uint *end = grid_end(g, y);
+    grid_text(g, y)[x] = cp;
+    grid_style(g, y)[x] = style;
+    *end = MAX(*end, x + 1);
+    grid_touch(g, y);
+}
+
+// Blank cells [x0, x1) of row y with the given style.
+static inline void grid_blank(JTermGrid *g, uint y, uint x0, uint x1,
+                              JTermStyle style) {
+    grid_fill(g, y, x0, x1, ' ', style);
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "hud.h"
+
+// pixels per font pixel, independent of the terminal's scale
+#define HUD_SCALE 1.5f
+#define HUD_COLUMNS 40
+#define BAR_WIDTH 16
+
+// upper bounds of the histogram buckets in ms, the last one catches the rest
+static const float buckets[] = {1, 2, 4, 8, 16.7f, 33.3f, 1e9f};
+#define BUCKET_COUNT (sizeof(buckets) / sizeof(buckets[0]))
+
+void hud_init(JTermHud *hud) {
+    *hud = (JTermHud){0};
+    hud->ctx = sdtx_make_context(&(sdtx_context_desc_t){
+        .char_buf_size = 2048,
+    });
+}
+
+void hud_free(JTermHud *hud) {
+    sdtx_destroy_context(hud->ctx);
+}
+
+void hud_add_frame(JTermHud *hud, double seconds) {
+    hud->frame_ms[hud->next] = seconds * 1e3;
+    hud->next = (hud->next + 1) % HUD_FRAMES;
+    hud->count = MIN(hud->count + 1, HUD_FRAMES);
+}
+
+static void histogram(const JTermHud *hud) {
+    uint counts[BUCKET_COUNT] = {0}, most = 1;
+
+    for (uint i = 0; i < hud->count; i++) {
+        uint b = 0;
+        while (hud->frame_ms[i] >= buckets[b])
+            b++;
+        counts[b]++;
+    }
+    for (uint b = 0; b < BUCKET_COUNT; b++)
+        most = MAX(most, counts[b]);
+
+    for (uint b = 0; b < BUCKET_COUNT; b++) {
+        if (b < BUCKET_COUNT - 1)
+            sdtx_printf(" <%5.1fms ", buckets[b]);
+        else
+            sdtx_printf(">=%5.1fms ", buckets[b - 1]);
+        uint bar = (counts[b] * BAR_WIDTH + most - 1) / most;
+        for (uint x = 0; x < BAR_WIDTH; x++)
+            sdtx_putc(x < bar ? '#' : '.');
+        sdtx_printf(" %4u\n", counts[b]);
+    }
+}
+
+void hud_draw(JTermHud *hud, const JTermHudStats *stats, float width,
+              float height) {
+    const JTermScrollbackStats *sb = &stats->scrollback;
+    float canvas_w = width / HUD_SCALE, canvas_h = height / HUD_SCALE;
+
+    sdtx_set_context(hud->ctx);
+    sdtx_canvas(canvas_w, canvas_h);
+    sdtx_origin(MAX(canvas_w / 8 - HUD_COLUMNS - 1, 0), 1);
+    sdtx_font(0);
+
+    sdtx_color3b(0xFF, 0xD0, 0x40);
+    sdtx_puts("jterm perf (F12)\n\n");
+    sdtx_color3b(0xE0, 0xE0, 0xE0);
+    sdtx_printf("frame cpu time, last %u\n", hud->count);
+    histogram(hud);
+    sdtx_printf("\npty      %8.2f MB/s\n", stats->ingest_mbps);
+    sdtx_printf("feed     %8.1f ns/byte\n", stats->feed_ns_per_byte);
+    sdtx_printf("rows     %8.1f rebuilt %6.1f kept\n", stats->rows_rebuilt,
+                stats->rows_reused);
+    sdtx_printf("dropped  %8lu glyphs\n", stats->dropped_glyphs);
+    sdtx_printf("history  %8lu lines\n", sb->lines);
+    sdtx_printf("  memory %8.1f MB hot %6.1f MB cold\n", sb->hot_bytes / 1e6,
+                sb->cold_bytes / 1e6);
+    if (sb->disk_pages)
+        sdtx_printf("  disk   %8.1f MB\n", sb->disk_bytes / 1e6);
+    sdtx_printf("echo     %8.1f ms p50 %6.1f ms p99\n",
+                stats->latency.key_echo_p50, stats->latency.key_echo_p99);
+    sdtx_printf("present  %8.1f ms p50 %6.1f ms p99\n",
+                stats->latency.echo_present_p50,
+                stats->latency.echo_present_p99);
+
+    sdtx_context_draw(hud->ctx);
+    sdtx_set_context(SDTX_DEFAULT_CONTEXT);
+}
@@ -0,0 +1,44 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "common.h"
+#include "ext/sokol_gfx.h"
+#include "ext/sokol_debugtext.h"
+#include "latency.h"
+#include "scrollback.h"
+
+// frame times kept for the histogram, a few seconds' worth
+#define HUD_FRAMES 256
+
+// What jterm measured over the last second, shown by the HUD.
+typedef struct {
+    double ingest_mbps;
+    double feed_ns_per_byte;
+    double rows_rebuilt, rows_reused;
+    // glyphs the font can't show, drawn as '?', since start
+    ulong dropped_glyphs;
+    JTermScrollbackStats scrollback;
+    JTermLatencyStats latency;
+} JTermHudStats;
+
+/* Performance overlay in the top right corner. It draws with its own
+ * debugtext context on top of the cells, so showing it changes nothing
+ * about how the grid is drawn. */
+typedef struct {
+    bool visible;
+    sdtx_context ctx;
+
+    // CPU time of the last HUD_FRAMES frames, circular
+    float frame_ms[HUD_FRAMES];
+    uint next, count;
+} JTermHud;
+
+// Needs sdtx_setup() with the cpc font first.
+void hud_init(JTermHud *hud);
+void hud_free(JTermHud *hud);
+void hud_add_frame(JTermHud *hud, double seconds);
+// Draw inside the current pass, width and height in framebuffer pixels.
+void hud_draw(JTermHud *hud, const JTermHudStats *stats, float width,
+              float height);
+
+#endif
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+
+void latency_init(JTermLatency *l) {
+    memset(l, 0, sizeof(*l));
+}
+
+void latency_key(JTermLatency *l, double now) {
+    if (l->npending == LATENCY_PENDING)
+        return;
+    l->pending[l->npending++] = (JTermKeyTimes){.key = now};
+}
+
+void latency_output(JTermLatency *l, double now) {
+    // walk back over the keys still waiting, they are at the end
+    for (uint i = l->npending; i-- > 0 && !l->pending[i].echo;)
+        l->pending[i].echo = now;
+}
+
+void latency_present(JTermLatency *l, double now) {
+    uint done = 0;
+
+    while (done < l->npending && l->pending[done].echo) {
+        const JTermKeyTimes *k = &l->pending[done++];
+        uint i = l->samples++ % LATENCY_SAMPLES;
+        l->key_echo[i] = (k->echo - k->key) * 1e3;
+        l->echo_present[i] = (now - k->echo) * 1e3;
+    }
+    l->npending -= done;
+    memmove(l->pending, &l->pending[done],
+            l->npending * sizeof(l->pending[0]));
+}
+
+static int compare_float(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// p is in percent, sorts samples
+static double percentile(float *samples, uint n, uint p) {
+    qsort(samples, n, sizeof(*samples), compare_float);
+    return samples[MIN(n * p / 100, n - 1)];
+}
+
+void latency_stats(const JTermLatency *l, JTermLatencyStats *s) {
+    float sorted[LATENCY_SAMPLES];
+    uint n = MIN(l->samples, LATENCY_SAMPLES);
+
+    *s = (JTermLatencyStats){.samples = l->samples};
+    if (!n)
+        return;
+
+    memcpy(sorted, l->key_echo, n * sizeof(*sorted));
+    s->key_echo_p50 = percentile(sorted, n, 50);
+    s->key_echo_p99 = percentile(sorted, n, 99);
+    memcpy(sorted, l->echo_present, n * sizeof(*sorted));
+    s->echo_present_p50 = percentile(sorted, n, 50);
+    s->echo_present_p99 = percentile(sorted, n, 99);
+}
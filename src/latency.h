@@ -0,0 +1,51 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "common.h"
+
+/* Input to photon latency, split at the echo: from a key being sent to
+ * the first output read after it, and from that output to the end of the
+ * first frame that shows it. Keys that are sent before the echo of the
+ * previous one arrived all take the same echo.
+ *
+ * "Presented" is when sg_commit() returned, which is as close to the
+ * screen as jterm can see; the swap and the compositor come on top. */
+
+// keys waiting for their echo or frame, more are not measured
+#define LATENCY_PENDING 64
+// samples the percentiles are taken over
+#define LATENCY_SAMPLES 1024
+
+typedef struct {
+    double key, echo;
+} JTermKeyTimes;
+
+typedef struct {
+    // oldest first, the ones with an echo come before the ones without
+    JTermKeyTimes pending[LATENCY_PENDING];
+    uint npending;
+
+    // in ms, circular
+    float key_echo[LATENCY_SAMPLES];
+    float echo_present[LATENCY_SAMPLES];
+    ulong samples;
+} JTermLatency;
+
+typedef struct {
+    ulong samples;
+    // ms
+    double key_echo_p50, key_echo_p99;
+    double echo_present_p50, echo_present_p99;
+} JTermLatencyStats;
+
+void latency_init(JTermLatency *l);
+// Input written to the PTY.
+void latency_key(JTermLatency *l, double now);
+// Output fed to the terminal.
+void latency_output(JTermLatency *l, double now);
+// A frame showing everything fed so far was committed.
+void latency_present(JTermLatency *l, double now);
+// Over the last LATENCY_SAMPLES keys.
+void latency_stats(const JTermLatency *l, JTermLatencyStats *s);
+
+#endif
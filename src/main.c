@@ -1,14 +1,24 @@
-#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
-#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "hud.h"
+#include "latency.h"
+#include "probes.h"
+#include "pty.h"
+#include "record.h"
+#include "render.h"
+#include "term.h"
+#include "trace.h"
 
 //---Sokol Headers---
 #define SOKOL_IMPL
@@ -28,72 +38,63 @@
 #define WINDOW_WIDTH 960
 #define WINDOW_HEIGHT 720
 
-#define CHAR_PIXELS 8
-#define CURSOR_CHAR 0x7c
+#define PTY_BUDGET_MIN (64 * 1024)
+#define PTY_BUDGET_MAX (16 * 1024 * 1024)
 
-#define SHELL "/bin/sh"
+#define CHAR_PIXELS 8
 
-typedef struct {
-    int master, slave;
-} PTY;
+// how much of the frame trace SIGUSR1 and Shift+F12 write out
+#define TRACE_SECONDS 10
 
 typedef struct {
     uint w, h;
 } JTermSize;
 
-typedef struct {
-    uint x, y;
-} JTermPos;
-
 typedef struct {
     sg_pass_action pass_action;
     uint font;
 
     PTY pty;
-    char *buffer;
-    JTermPos pos;
+    JTerm term;
     JTermSize size;
     float scale;
-    bool just_wrapped;
+    // how many lines the view is scrolled back into history
+    ulong view;
+    // something changed since the last frame, draw it without waiting
+    bool redraw;
+
+    // bytes read_pty() may process in one frame, adapts to the backlog
+    size_t pty_budget;
+    struct {
+        double since;
+        ulong bytes;
+        double mbps;
+        // fed to the terminal and the time term_feed() took for it
+        ulong fed;
+        double feed_seconds;
+    } ingest;
+    // from keys to their echo on screen
+    JTermLatency latency;
+
+    JTermRenderer renderer;
+    // JTERM_RECORD, written to while open
+    JTermRecorder recorder;
+    // rows render_update() rebuilt and reused, summed since the last report
+    struct {
+        ulong rebuilt, reused, frames;
+    } rows;
+
+    JTermHud hud;
+    JTermHudStats hud_stats;
+
+    // JTERM_TRACE, where the frame trace is written
+    const char *trace_path;
+    JTermTrace trace;
+    volatile sig_atomic_t trace_requested;
 } JTermState;
 
 JTermState state;
 
-void pt_pair(PTY *pty) {
-    char *slave_name;
-
-    // Opens the PTY master device.
-    pty->master = posix_openpt(O_RDWR | O_NOCTTY);
-    if (pty->master == -1) {
-        ERROR("posix_openpt");
-    }
-    /* grantpt() and unlockpt() are housekeeping functions that have to
-     * be called before we can open the slave FD. Refer to the manpages
-     * on what they do. */
-    if (grantpt(pty->master) == -1) {
-        perror("grantpt");
-    }
-
-    if (unlockpt(pty->master) == -1) {
-        ERROR("unlockpt");
-    }
-
-    /* Up until now, we only have the master FD. We also need a file
-     * descriptor for our child process. We get it by asking for the
-     * actual path in /dev/pts which we then open using a regular
-     * ope(). So, unlike pipe(), you don't get two corresponding file
-     * descriptors in one go. */
-    slave_name = ptsname(pty->master);
-    if (slave_name == NULL) {
-        ERROR("ptsname");
-    }
-
-    pty->slave = open(slave_name, O_RDWR | O_NOCTTY);
-    if (pty->slave == -1) {
-        ERROR("open(slave_name)");
-    }
-}
-
 void term_set_size() {
     struct winsize ws = {
         .ws_col = state.size.w,
@@ -112,35 +113,33 @@ void term_set_size() {
     }
 }
 
-void spawn_shell(PTY *pty) {
-    pid_t pid;
-
-    pid = fork();
-    if (pid == 0) {
-        close(pty->master);
+/* Whichever thread gets the signal, the wakeup pipe gets an idle frame
+ * loop going again to write the trace. */
+static void request_trace(int sig) {
+    (void)sig;
+    int saved = errno;
+    state.trace_requested = 1;
+    write(state.pty.wakeup[1], "", 1);
+    errno = saved;
+}
 
-        /* Create a new session and make our terminal this process'
-           controlling terminal. */
-        setsid();
-        if (ioctl(pty->slave, TIOCSCTTY, NULL) == -1) {
-            ERROR("ioctl(TIOCSCTTY)");
-        }
+static void dump_trace() {
+    state.trace_requested = 0;
+    if (trace_dump(&state.trace, state.trace_path, TRACE_SECONDS))
+        LOG("trace: last %ds written to %s", TRACE_SECONDS, state.trace_path);
+    else
+        WARN("trace: can't write %s", state.trace_path);
+}
 
-        // close the shell's io fd's
-        dup2(pty->slave, STDIN_FILENO);
-        dup2(pty->slave, STDOUT_FILENO);
-        dup2(pty->slave, STDERR_FILENO);
-        close(pty->slave);
-
-        setenv("TERM", "dumb", 1);
-        execl(SHELL, "-" SHELL, (char *)NULL);
-        ERROR("could not execute %s", SHELL);
-    } else if (pid > 0) {
-        close(pty->slave);
-        return;
-    }
+// Everything for the child goes through the PTY's input queue.
+static void queue_input(const void *buf, size_t n) {
+    record_input(&state.recorder, buf, n);
+    pt_queue_input(&state.pty, buf, n);
+}
 
-    ERROR("fork");
+static void send_reply(void *user, const uchar *buf, size_t n) {
+    (void)user;
+    queue_input(buf, n);
 }
 
 static void init() {
@@ -149,7 +148,7 @@ static void init() {
         .colors[0] =
             {
                 .load_action = SG_LOADACTION_CLEAR,
-                .clear_value = sg_make_color_4b(0x18, 0x18, 0x18, 0xFF),
+                .clear_value = BACKGROUND_RGBA,
             },
     };
     state.scale = 1.25f;
@@ -157,12 +156,33 @@ static void init() {
         .w = sapp_width() / (CHAR_PIXELS * state.scale),
         .h = sapp_height() / (CHAR_PIXELS * state.scale),
     };
-    state.pos = (JTermPos){0, 0};
-    state.buffer = calloc(state.size.h * state.size.w + 1, sizeof(char));
+    term_init(&state.term, state.size.w, state.size.h);
+    state.term.reply = send_reply;
+    const char *budget = getenv("JTERM_SCROLLBACK_MB");
+    if (budget)
+        scrollback_set_budget(&state.term.scrollback,
+                              strtoul(budget, NULL, 10) * 1024 * 1024);
+    const char *disk = getenv("JTERM_SCROLLBACK_DISK");
+    if (disk && !scrollback_enable_disk(&state.term.scrollback, disk))
+        WARN("no on-disk scrollback in %s", disk);
+    const char *record = getenv("JTERM_RECORD");
+    if (record &&
+        !record_open(&state.recorder, record, state.size.w, state.size.h))
+        WARN("can't record to %s", record);
+    state.trace_path = getenv("JTERM_TRACE");
+    trace_init(&state.trace, state.trace_path);
+    state.pty_budget = PTY_BUDGET_MIN;
+    state.redraw = true;
+    state.ingest.since = now_seconds();
+    latency_init(&state.latency);
 
     pt_pair(&state.pty);
     spawn_shell(&state.pty);
     term_set_size();
+    pt_start_reader(&state.pty);
+    if (state.trace_path)
+        sigaction(SIGUSR1, &(struct sigaction){.sa_handler = request_trace},
+                  NULL);
 
     //---Initialize sokol modules---
     sg_setup(&(sg_desc){
@@ -171,322 +191,247 @@ static void init() {
     });
 
     sdtx_setup(&(sdtx_desc_t){
-        .fonts =
-            {
-                sdtx_font_cpc(),
-                sdtx_font_oric(),
-            },
+        .fonts[0] = sdtx_font_cpc(),
         .logger.func = slog_func,
     });
 
+    render_init(&state.renderer);
+    hud_init(&state.hud);
     state.font = 0;
 }
 
-#define POLL_TIMEOUT_MS 10
-#define POLL_TIMEOUT_US (POLL_TIMEOUT_MS * 1000)
-#define BUF_SIZE 1024
-void read_pty() {
-    char buf[BUF_SIZE];
-    uint n = 0;
-    fd_set readable;
-    struct timeval timeout;
-
-    FD_ZERO(&readable);
-    FD_SET(state.pty.master, &readable);
-    timeout.tv_sec = 0;
-    timeout.tv_usec = POLL_TIMEOUT_US;
-
-    if (select(state.pty.master + 1, &readable, NULL, NULL, &timeout) == -1) {
-        perror(NULL);
-        ERROR("select");
-    }
-
-    if (!FD_ISSET(state.pty.master, &readable))
+// Once a second, for the log and the HUD.
+static void sample_stats() {
+    double now = now_seconds(), elapsed = now - state.ingest.since;
+    if (elapsed < 1.0)
         return;
 
-    if ((n = read(state.pty.master, buf, BUF_SIZE)) <= 0) {
-        // child exit
-        LOG("Nothing to read from child: ");
-        perror(NULL);
-        sapp_quit();
-    }
-
-    for (int i = 0; i < n; i++) {
-        switch (buf[i]) {
-        case '\r':
-            state.buffer[state.pos.y * state.size.w + state.pos.x] = '\r';
-            state.pos.x = 0;
-            break;
-        case '\n':
-            if (!state.just_wrapped) {
-                /* We read a newline and if we did *not* implicitly
-                 * wrap to the next line */
-                state.pos.y++;
-                state.buffer[state.pos.y * state.size.w + state.pos.x] = '\n';
-                state.just_wrapped = false;
-            }
-            break;
-        case '\b':
-        case 0x7F:
-            state.pos.x--;
-            state.buffer[state.pos.y * state.size.w + state.pos.x] = '\0';
-            break;
-        default:
-            /* If this is a regular byte, store it and advance
-             * the cursor one cell to the right. */
-            state.buffer[state.pos.y * state.size.w + state.pos.x] = buf[i];
-            state.pos.x++;
-            if (state.pos.x >= state.size.w) {
-                state.pos.x = 0;
-                state.pos.y++;
-                state.just_wrapped = true;
-            } else
-                state.just_wrapped = false;
-        }
-
-        // Shift the entire content one line up and then stay in the very last
-        // line.
-        if (state.pos.y >= state.size.h) {
-            memmove(state.buffer, &state.buffer[state.size.w],
-                    state.size.w * (state.size.h - 1));
-
-            state.pos.y = state.size.h - 1;
-            for (int i = 0; i < state.size.w; i++)
-                state.buffer[state.pos.y * state.size.w + i] = 0;
-        }
+    JTermHudStats *hs = &state.hud_stats;
+    ulong total = __atomic_load_n(&state.pty.bytes_read, __ATOMIC_RELAXED);
+    state.ingest.mbps =
+        (total - state.ingest.bytes) / elapsed / (1024.0 * 1024.0);
+    if (total != state.ingest.bytes)
+        LOG("pty: %.2f MB/s ingested", state.ingest.mbps);
+    hs->ingest_mbps = state.ingest.mbps;
+    if (state.ingest.fed)
+        hs->feed_ns_per_byte =
+            state.ingest.feed_seconds * 1e9 / state.ingest.fed;
+
+    hs->rows_rebuilt = hs->rows_reused = 0;
+    if (state.rows.frames) {
+        hs->rows_rebuilt = (double)state.rows.rebuilt / state.rows.frames;
+        hs->rows_reused = (double)state.rows.reused / state.rows.frames;
     }
+    if (state.rows.rebuilt)
+        LOG("render: %.1f rows rebuilt, %.1f reused per frame",
+            hs->rows_rebuilt, hs->rows_reused);
+    hs->dropped_glyphs = state.term.dropped_glyphs;
+    scrollback_stats(&state.term.scrollback, &hs->scrollback);
+    latency_stats(&state.latency, &hs->latency);
+
+    state.rows.rebuilt = state.rows.reused = state.rows.frames = 0;
+    state.ingest.fed = 0;
+    state.ingest.feed_seconds = 0;
+    state.ingest.bytes = total;
+    state.ingest.since = now;
+    if (state.hud.visible)
+        state.redraw = true;
 }
 
-#define WHITE_COLOR (sg_color){0.9f, 0.9f, 0.9f, 1.0f}
-// TODO: More escape sequences
-void handle_esc_sequence(uint *pos) {
-    *pos += 1;
-    char c = state.buffer[*pos];
-    if (c != '[') {
-        return;
+// Returns whether anything was fed to the terminal.
+bool read_pty() {
+    uchar *buf;
+    size_t n, budget = state.pty_budget, left = budget;
+
+    /* The reader thread has already pulled whatever the shell wrote into
+     * the ring, so this never waits on the child. */
+    double start = now_seconds();
+    while (left && (n = ring_read_span(&state.pty.ring, &buf)) > 0) {
+        n = MIN(n, left);
+        double feed = trace_begin(&state.trace);
+        term_feed(&state.term, buf, n);
+        trace_end(&state.trace, "term_feed", feed, n);
+        record_output(&state.recorder, buf, n);
+        pt_consume(&state.pty, n);
+        left -= n;
+    }
+    if (left != budget) {
+        double now = now_seconds();
+        state.ingest.fed += budget - left;
+        state.ingest.feed_seconds += now - start;
+        latency_output(&state.latency, now);
     }
 
-    sg_color color = WHITE_COLOR;
-    int values[4] = {0}, value_count = 0;
-    for (;;) {
-        *pos += 1;
-        c = state.buffer[*pos];
-        if (isdigit(c)) {
-            char *p = &state.buffer[*pos];
-            char *endptr;
-            int digit = strtol(p, &endptr, 0);
-            values[value_count++] = digit;
-            *pos += endptr - p - 1;
-            switch (digit) {
-            case 0:
-                // Reset
-                color = WHITE_COLOR;
-                break;
-            case 30:
-                color = (sg_color)SG_BLACK;
-                break;
-            case 31:
-                color = (sg_color)SG_RED;
-                break;
-            case 32:
-                color = (sg_color)SG_GREEN;
-                break;
-            case 33:
-                color = (sg_color)SG_YELLOW;
-                break;
-            case 34:
-                color = (sg_color)SG_BLUE;
-                break;
-            case 35:
-                color = (sg_color)SG_MAGENTA;
-                break;
-            case 36:
-                color = (sg_color)SG_CYAN;
-                break;
-            case 37:
-                color = (sg_color)WHITE_COLOR;
-                break;
+    /* Grow the budget while we keep falling behind, shrink it back once
+     * a frame drains everything with room to spare. */
+    if (!left && ring_used(&state.pty.ring))
+        state.pty_budget = MIN(state.pty_budget * 2, PTY_BUDGET_MAX);
+    else if (left > state.pty_budget / 2)
+        state.pty_budget = MAX(state.pty_budget / 2, PTY_BUDGET_MIN);
 
-            case 90:
-                color = (sg_color)SG_GRAY;
-                break;
-            case 91:
-                color = (sg_color)SG_PALE_VIOLET_RED;
-                break;
-            case 92:
-                color = (sg_color)SG_LIGHT_GREEN;
-                break;
-            case 93:
-                color = (sg_color)SG_LIGHT_YELLOW;
-                break;
-            case 94:
-                color = (sg_color)SG_LIGHT_BLUE;
-                break;
-            case 95:
-                color = (sg_color)SG_PINK;
-                break;
-            case 96:
-                color = (sg_color)SG_LIGHT_CYAN;
-                break;
-            case 97:
-                color = (sg_color)SG_WHITE;
-                break;
+    sample_stats();
+    trace_end(&state.trace, "read_pty", start, budget - left);
 
-            default:
-            }
-        } else {
-            JTermPos cpos = {*pos / state.size.w, *pos % state.size.w};
-            switch (c) {
-            case ';':
-                continue;
-            case 'm':
-                sdtx_color4f(color.r, color.g, color.g, color.a);
-                return;
+    if (pt_finished(&state.pty)) {
+        // child exit
+        LOG("Nothing to read from child");
+        sapp_quit();
+    }
+    return left != budget;
+}
 
-            case 'A': {
-                int n = values[0] ? values[0] : 1;
-                n = MIN(n, cpos.y);
-                sdtx_move_y(-n);
-                return;
-            }
-            case 'B': {
-                int n = values[0] ? values[0] : 1;
-                n = MIN(n, state.size.h - cpos.y);
-                sdtx_move_y(n);
-                return;
-            }
-            case 'C': {
-                int n = values[0] ? values[0] : 1;
-                n = MIN(n, state.size.w - cpos.x);
-                sdtx_move_x(n);
-                return;
-            }
-            case 'D': {
-                int n = values[0] ? values[0] : 1;
-                n = MIN(n, cpos.x);
-                sdtx_move_x(-n);
-                return;
-            }
-            case 'E':
-                if (values[0])
-                    sdtx_move_y(values[0]);
-                else
-                    sdtx_move_y(1);
-                return;
-            case 'F':
-                if (values[0])
-                    sdtx_move_y(-values[0]);
-                else
-                    sdtx_move_y(-1);
-                return;
-            case 'G':
-                if (values[0])
-                    sdtx_pos_x(values[0]);
-                else
-                    sdtx_pos_x(1);
-                return;
-            case 'H':
-                if (values[0])
-                    sdtx_pos_y(values[0]);
-                else
-                    sdtx_pos_y(1);
-                if (values[1])
-                    sdtx_pos_x(values[1]);
-                else
-                    sdtx_pos_x(1);
-                return;
-            case 'J': {
-                return;
-            }
-            case 'K': {
-                return;
-            }
-            case '?':
-                *pos += 2;
-                return;
+/* Sleep until the shell writes something or the window system has an
+ * event for us. Only the X11 loop can block here; elsewhere it returns
+ * right away. */
+static void wait_for_work(double due) {
+#if defined(_SAPP_LINUX)
+    pt_arm_wakeup(&state.pty);
+    if (ring_used(&state.pty.ring) ||
+        __atomic_load_n(&state.pty.closed, __ATOMIC_ACQUIRE))
+        return;
+    // events Xlib already pulled off the socket won't wake poll()
+    if (XEventsQueued(_sapp.x11.display, QueuedAlready))
+        return;
 
-            default:
-                return;
-            }
-        }
+    struct pollfd fds[3] = {
+        {.fd = state.pty.wakeup[0], .events = POLLIN},
+        {.fd = ConnectionNumber(_sapp.x11.display), .events = POLLIN},
+        // input the child didn't take yet goes out once it reads again
+        {.fd = state.pty.master, .events = POLLOUT},
+    };
+    nfds_t nfds = pt_input_pending(&state.pty) ? 3 : 2;
+    // the HUD refreshes once a second even when idle
+    int timeout = state.hud.visible ? 1000 : -1;
+    // and the terminal wants its tick
+    if (due >= 0 && (timeout < 0 || due * 1000 < timeout))
+        timeout = due * 1000 + 1;
+    if (poll(fds, nfds, timeout) == -1 && errno != EINTR) {
+        ERROR("poll");
     }
+#endif
 }
 
 static void frame() {
-
-    read_pty();
-
-    //---Text---
-    // characters are all 8x8 pixels on the virtual canvas
-    // so we set set lower canvas resolution for increased text size
-    sdtx_canvas(sapp_widthf() / state.scale, sapp_heightf() / state.scale);
-
-    // all movement is relative to this origin and is all in character units
-    sdtx_origin(0, 0);
-    sdtx_color4f(WHITE_COLOR.r, WHITE_COLOR.g, WHITE_COLOR.b, WHITE_COLOR.a);
-    sdtx_font(state.font);
-
-    // render the buffer character by character to handle escape sequences
-    for (uint i = 0; i <= state.pos.y * state.size.w + state.pos.x; i++) {
-        char c = state.buffer[i];
-        if (!c)
-            continue;
-        if (i % state.size.w == 0 || c == '\n') {
-            sdtx_crlf();
-        } else if (c == '\r') {
-            sdtx_pos_x(1);
-        }
-
-        // When we find esc the upcoming sequence must be handled
-        if (c == '\x1b') {
-            handle_esc_sequence(&i);
-        } else
-            sdtx_putc(c);
+    JTermTrace *trace = &state.trace;
+    double start = now_seconds(), phase;
+
+    if (state.trace_requested)
+        dump_trace();
+    // whatever the events of this frame queued, in one write
+    pt_flush_input(&state.pty);
+    if (read_pty())
+        state.redraw = true;
+    double due = term_tick(&state.term, start);
+    /* Nothing to show, so sleep before drawing. The frame is drawn either
+     * way: sokol presents after every frame callback and a skipped draw
+     * would present a back buffer with nothing or an old frame in it.
+     * With no dirty rows that is a draw of what is already uploaded. */
+    if (!state.redraw) {
+        phase = trace_begin(trace);
+        wait_for_work(due);
+        trace_end(trace, "idle", phase, 0);
+        read_pty();
+        // the frame span and the HUD histogram are work, not the sleep
+        start = now_seconds();
     }
-
-    sdtx_color3b(0xAF, 0xAF, 0xAF);
-    sdtx_putc(CURSOR_CHAR);
+    state.redraw = false;
+    PROBE0(frame_begin);
+
+    JTerm *t = &state.term;
+    state.view = MIN(state.view, scrollback_lines(&t->scrollback));
+    phase = trace_begin(trace);
+    render_update(&state.renderer, t, state.view);
+    trace_end(trace, "render_update", phase, 0);
+    state.rows.rebuilt += state.renderer.cells.rebuilt;
+    state.rows.reused += state.renderer.cells.reused;
+    state.rows.frames++;
 
     // Render pass
     sg_begin_pass(&(sg_pass){
         .action = state.pass_action,
         .swapchain = sglue_swapchain(),
     });
-    sdtx_draw();
+    phase = trace_begin(trace);
+    render_draw(&state.renderer, state.font, CHAR_PIXELS * state.scale,
+                sapp_widthf(), sapp_heightf());
+    trace_end(trace, "render_draw", phase, 0);
+    if (state.hud.visible) {
+        phase = trace_begin(trace);
+        hud_draw(&state.hud, &state.hud_stats, sapp_widthf(), sapp_heightf());
+        trace_end(trace, "hud_draw", phase, 0);
+    }
+    phase = trace_begin(trace);
     sg_end_pass();
+    trace_end(trace, "sg_end_pass", phase, 0);
 
+    phase = trace_begin(trace);
     sg_commit();
+    trace_end(trace, "sg_commit", phase, 0);
+    latency_present(&state.latency, now_seconds());
+    trace_end(trace, "frame", start, 0);
+    PROBE1(frame_end, state.renderer.cells.rebuilt);
+    hud_add_frame(&state.hud, now_seconds() - start);
+}
+
+static void send_input(const void *buf, size_t n) {
+    latency_key(&state.latency, now_seconds());
+    queue_input(buf, n);
+}
+
+static void paste() {
+    const char *text = sapp_get_clipboard_string();
+    state.view = 0;
+    queue_input(text, strlen(text));
 }
 
 static void cleanup() {
+    JTermLatencyStats latency;
+    latency_stats(&state.latency, &latency);
+    if (latency.samples)
+        LOG("latency: %lu keys, key to echo %.1f ms p50 %.1f ms p99, "
+            "echo to present %.1f ms p50 %.1f ms p99",
+            latency.samples, latency.key_echo_p50, latency.key_echo_p99,
+            latency.echo_present_p50, latency.echo_present_p99);
+
+    record_close(&state.recorder);
+    trace_free(&state.trace);
+    hud_free(&state.hud);
+    render_free(&state.renderer);
     sdtx_shutdown();
     sg_shutdown();
 }
 
 void rescale_terminal() {
-    JTermSize old_size = state.size;
     state.size = (JTermSize){
         .w = sapp_width() / (CHAR_PIXELS * state.scale),
         .h = sapp_height() / (CHAR_PIXELS * state.scale),
     };
-    if (state.size.w * state.size.h > old_size.w * old_size.h) {
-        state.buffer = realloc(state.buffer, state.size.w * state.size.h);
-
-        uint empty_bytes =
-            state.size.w * state.size.h - old_size.w * old_size.h;
-
-        memset(&state.buffer[old_size.w * old_size.h], 0, empty_bytes);
-        // TODO: copy everything over
-    }
+    term_resize(&state.term, state.size.w, state.size.h);
+    record_resize(&state.recorder, state.size.w, state.size.h);
+    term_set_size();
 }
 
 static void event(const sapp_event *event) {
     char c[4] = {0};
+
+    // the pointer isn't drawn, everything else may change the picture
+    if (event->type != SAPP_EVENTTYPE_MOUSE_MOVE &&
+        event->type != SAPP_EVENTTYPE_MOUSE_ENTER &&
+        event->type != SAPP_EVENTTYPE_MOUSE_LEAVE)
+        state.redraw = true;
+
     switch (event->type) {
     case SAPP_EVENTTYPE_KEY_DOWN: {
         if (event->key_code == SAPP_KEYCODE_ESCAPE) {
             sapp_quit();
         }
+        if (event->key_code == SAPP_KEYCODE_F12) {
+            if (!(event->modifiers & SAPP_MODIFIER_SHIFT))
+                state.hud.visible = !state.hud.visible;
+            else if (trace_enabled(&state.trace))
+                dump_trace();
+            return;
+        }
 
 // ctrl codes
 #define MIN_SCALE 0.25f
@@ -506,9 +451,7 @@ static void event(const sapp_event *event) {
                 }
                 break;
             case SAPP_KEYCODE_L:
-                memset(state.buffer, 0,
-                       state.pos.y * state.size.w + state.pos.x);
-                state.pos = (JTermPos){0};
+                term_clear(&state.term);
                 break;
 
             case SAPP_KEYCODE_A:
@@ -541,44 +484,66 @@ static void event(const sapp_event *event) {
             case SAPP_KEYCODE_U:
                 c[0] = 0x15;
                 break;
+            case SAPP_KEYCODE_V:
+                // sokol only reports pastes on macOS and Windows
+                if (event->modifiers & SAPP_MODIFIER_SHIFT)
+                    paste();
+                break;
             default:
             }
 
             if (*c)
-                write(state.pty.master, c, 1);
+                send_input(c, 1);
             return;
         }
 
+        // Scrollback
+        if (event->modifiers & SAPP_MODIFIER_SHIFT) {
+            switch (event->key_code) {
+            case SAPP_KEYCODE_PAGE_UP:
+                state.view += state.size.h / 2;
+                return;
+            case SAPP_KEYCODE_PAGE_DOWN:
+                state.view -= MIN(state.view, state.size.h / 2);
+                return;
+            default:
+            }
+        }
+        // typing jumps back to the live screen, modifiers alone don't
+        if (event->key_code < SAPP_KEYCODE_LEFT_SHIFT ||
+            event->key_code > SAPP_KEYCODE_RIGHT_SUPER)
+            state.view = 0;
+
         // Sending escape codes
 #ifndef __APPLE__
         switch (event->key_code) {
         case SAPP_KEYCODE_BACKSPACE:
             c[0] = '\b';
-            write(state.pty.master, c, 1);
+            send_input(c, 1);
             break;
         case SAPP_KEYCODE_TAB:
             c[0] = '\t';
-            write(state.pty.master, c, 1);
+            send_input(c, 1);
             break;
         case SAPP_KEYCODE_ENTER:
             c[0] = '\n';
-            write(state.pty.master, c, 1);
+            send_input(c, 1);
             break;
         case SAPP_KEYCODE_UP: {
             char seq[] = "\x1b[A";
-            write(state.pty.master, seq, 3);
+            send_input(seq, 3);
         } break;
         case SAPP_KEYCODE_DOWN: {
             char seq[] = "\x1b[B";
-            write(state.pty.master, seq, 3);
+            send_input(seq, 3);
         } break;
         case SAPP_KEYCODE_RIGHT: {
             char seq[] = "\x1b[C";
-            write(state.pty.master, seq, 3);
+            send_input(seq, 3);
         } break;
         case SAPP_KEYCODE_LEFT: {
             char seq[] = "\x1b[D";
-            write(state.pty.master, seq, 3);
+            send_input(seq, 3);
         } break;
         default: // Nothing
         }
@@ -587,15 +552,19 @@ static void event(const sapp_event *event) {
     case SAPP_EVENTTYPE_CHAR:
         if (!(event->modifiers & SAPP_MODIFIER_CTRL)) {
             c[0] = event->char_code;
-            write(state.pty.master, c, 1);
+            send_input(c, 1);
         }
         break;
 
+    case SAPP_EVENTTYPE_CLIPBOARD_PASTED:
+        paste();
+        break;
+
     case SAPP_EVENTTYPE_MOUSE_SCROLL:
         if (event->scroll_y > 0.0f) {
-            state.font = (state.font + 1) % 2;
+            state.font = (state.font + 1) % RENDER_FONTS;
         } else {
-            state.font = (state.font - 1) % 2;
+            state.font = (state.font + RENDER_FONTS - 1) % RENDER_FONTS;
         }
         break;
 
@@ -0,0 +1,411 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86
+#endif
+
+#include "parser.h"
+#include "probes.h"
+
+enum {
+    STATE_GROUND,
+    STATE_ESCAPE,
+    STATE_ESCAPE_INTERMEDIATE,
+    STATE_CSI_ENTRY,
+    STATE_CSI_PARAM,
+    STATE_CSI_INTERMEDIATE,
+    STATE_CSI_IGNORE,
+    STATE_DCS_ENTRY,
+    STATE_DCS_PARAM,
+    STATE_DCS_INTERMEDIATE,
+    STATE_DCS_PASSTHROUGH,
+    STATE_DCS_IGNORE,
+    STATE_OSC_STRING,
+    STATE_SOS_PM_APC_STRING,
+    STATE_COUNT,
+
+    // next state meaning "no transition", entry/exit actions don't run
+    STATE_STAY = 0xF,
+};
+
+enum {
+    ACTION_NONE,
+    ACTION_PRINT,
+    ACTION_UTF8,
+    ACTION_EXECUTE,
+    ACTION_CLEAR,
+    ACTION_COLLECT,
+    ACTION_PARAM,
+    ACTION_ESC_DISPATCH,
+    ACTION_CSI_DISPATCH,
+    ACTION_OSC_START,
+    ACTION_OSC_PUT,
+    ACTION_OSC_END,
+};
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+//---Printable runs---
+/* Ground state output is mostly long runs of printable ASCII. These find
+ * where such a run ends so it can be handed to print_run in one go
+ * instead of taking the table for every byte. */
+typedef size_t (*ScanFn)(const uchar *buf, size_t n);
+static ScanFn scan_printable;
+
+static inline bool printable(uchar c) {
+    return c >= 0x20 && c <= 0x7E;
+}
+
+static size_t scan_scalar(const uchar *buf, size_t n) {
+    size_t i = 0;
+    const ulong ones = ~0UL / 255, highs = ones * 0x80;
+
+    // eight bytes at a time: any byte < 0x20, > 0x7E or >= 0x80
+    for (; i + sizeof(ulong) <= n; i += sizeof(ulong)) {
+        ulong v;
+        memcpy(&v, &buf[i], sizeof(v));
+        ulong below = (v - ones * 0x20) & ~v;
+        // 0x7F + 1 carries into the high bit
+        ulong above = (v + ones) | v;
+        if ((below | above) & highs)
+            break;
+    }
+    while (i < n && printable(buf[i]))
+        i++;
+    return i;
+}
+
+#ifdef HAVE_X86
+static size_t scan_sse2(const uchar *buf, size_t n) {
+    size_t i = 0;
+    const __m128i lo = _mm_set1_epi8(0x20), hi = _mm_set1_epi8(0x7E);
+
+    /* Signed compares: bytes >= 0x80 are negative and end up below
+     * 0x20, so one range check covers C0, DEL and non-ASCII. */
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&buf[i]);
+        __m128i bad =
+            _mm_or_si128(_mm_cmplt_epi8(v, lo), _mm_cmpgt_epi8(v, hi));
+        uint mask = _mm_movemask_epi8(bad);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scan_scalar(&buf[i], n - i);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2(const uchar *buf,
+                                                         size_t n) {
+    size_t i = 0;
+    // short runs aren't worth waking up the 256 bit units for
+    if (n < 32)
+        return scan_scalar(buf, n);
+
+    const __m256i lo = _mm256_set1_epi8(0x20), hi = _mm256_set1_epi8(0x7E);
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&buf[i]);
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi8(lo, v),
+                                      _mm256_cmpgt_epi8(v, hi));
+        uint mask = _mm256_movemask_epi8(bad);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scan_sse2(&buf[i], n - i);
+}
+#endif
+
+static void pick_scanner() {
+    scan_printable = scan_scalar;
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        scan_printable = scan_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        scan_printable = scan_sse2;
+#endif
+}
+
+/* One byte per (state, input): action in the high nibble, next state in
+ * the low nibble. Built once from the range rules below. */
+static uchar table[STATE_COUNT][256];
+static bool table_ready;
+
+static void rule(uint state, uint lo, uint hi, uint action, uint next) {
+    for (uint c = lo; c <= hi; c++)
+        table[state][c] = action << 4 | next;
+}
+
+// C0 controls minus the ones with "anywhere" transitions
+static void rule_c0(uint state, uint action) {
+    rule(state, 0x00, 0x17, action, STATE_STAY);
+    rule(state, 0x19, 0x19, action, STATE_STAY);
+    rule(state, 0x1C, 0x1F, action, STATE_STAY);
+}
+
+static void build_table() {
+    for (uint s = 0; s < STATE_COUNT; s++) {
+        rule(s, 0x00, 0xFF, ACTION_NONE, STATE_STAY);
+
+        // anywhere
+        rule(s, 0x18, 0x18, ACTION_EXECUTE, STATE_GROUND);
+        rule(s, 0x1A, 0x1A, ACTION_EXECUTE, STATE_GROUND);
+        rule(s, 0x1B, 0x1B, ACTION_NONE, STATE_ESCAPE);
+    }
+
+    rule_c0(STATE_GROUND, ACTION_EXECUTE);
+    rule(STATE_GROUND, 0x20, 0x7E, ACTION_PRINT, STATE_STAY);
+    rule(STATE_GROUND, 0x80, 0xFF, ACTION_UTF8, STATE_STAY);
+
+    rule_c0(STATE_ESCAPE, ACTION_EXECUTE);
+    rule(STATE_ESCAPE, 0x20, 0x2F, ACTION_COLLECT, STATE_ESCAPE_INTERMEDIATE);
+    rule(STATE_ESCAPE, 0x30, 0x7E, ACTION_ESC_DISPATCH, STATE_GROUND);
+    rule(STATE_ESCAPE, 0x5B, 0x5B, ACTION_NONE, STATE_CSI_ENTRY);
+    rule(STATE_ESCAPE, 0x5D, 0x5D, ACTION_NONE, STATE_OSC_STRING);
+    rule(STATE_ESCAPE, 0x50, 0x50, ACTION_NONE, STATE_DCS_ENTRY);
+    rule(STATE_ESCAPE, 0x58, 0x58, ACTION_NONE, STATE_SOS_PM_APC_STRING);
+    rule(STATE_ESCAPE, 0x5E, 0x5F, ACTION_NONE, STATE_SOS_PM_APC_STRING);
+
+    rule_c0(STATE_ESCAPE_INTERMEDIATE, ACTION_EXECUTE);
+    rule(STATE_ESCAPE_INTERMEDIATE, 0x20, 0x2F, ACTION_COLLECT, STATE_STAY);
+    rule(STATE_ESCAPE_INTERMEDIATE, 0x30, 0x7E, ACTION_ESC_DISPATCH,
+         STATE_GROUND);
+
+    // ':' sub-parameters are treated like ';' rather than ignored
+    rule_c0(STATE_CSI_ENTRY, ACTION_EXECUTE);
+    rule(STATE_CSI_ENTRY, 0x20, 0x2F, ACTION_COLLECT, STATE_CSI_INTERMEDIATE);
+    rule(STATE_CSI_ENTRY, 0x30, 0x3B, ACTION_PARAM, STATE_CSI_PARAM);
+    rule(STATE_CSI_ENTRY, 0x3C, 0x3F, ACTION_COLLECT, STATE_CSI_PARAM);
+    rule(STATE_CSI_ENTRY, 0x40, 0x7E, ACTION_CSI_DISPATCH, STATE_GROUND);
+
+    rule_c0(STATE_CSI_PARAM, ACTION_EXECUTE);
+    rule(STATE_CSI_PARAM, 0x20, 0x2F, ACTION_COLLECT, STATE_CSI_INTERMEDIATE);
+    rule(STATE_CSI_PARAM, 0x30, 0x3B, ACTION_PARAM, STATE_STAY);
+    rule(STATE_CSI_PARAM, 0x3C, 0x3F, ACTION_NONE, STATE_CSI_IGNORE);
+    rule(STATE_CSI_PARAM, 0x40, 0x7E, ACTION_CSI_DISPATCH, STATE_GROUND);
+
+    rule_c0(STATE_CSI_INTERMEDIATE, ACTION_EXECUTE);
+    rule(STATE_CSI_INTERMEDIATE, 0x20, 0x2F, ACTION_COLLECT, STATE_STAY);
+    rule(STATE_CSI_INTERMEDIATE, 0x30, 0x3F, ACTION_NONE, STATE_CSI_IGNORE);
+    rule(STATE_CSI_INTERMEDIATE, 0x40, 0x7E, ACTION_CSI_DISPATCH,
+         STATE_GROUND);
+
+    rule_c0(STATE_CSI_IGNORE, ACTION_EXECUTE);
+    rule(STATE_CSI_IGNORE, 0x40, 0x7E, ACTION_NONE, STATE_GROUND);
+
+    // DCS payloads are parsed so they can't leak onto the screen, but
+    // nothing consumes them yet
+    rule(STATE_DCS_ENTRY, 0x20, 0x2F, ACTION_COLLECT, STATE_DCS_INTERMEDIATE);
+    rule(STATE_DCS_ENTRY, 0x30, 0x3B, ACTION_PARAM, STATE_DCS_PARAM);
+    rule(STATE_DCS_ENTRY, 0x3C, 0x3F, ACTION_COLLECT, STATE_DCS_PARAM);
+    rule(STATE_DCS_ENTRY, 0x40, 0x7E, ACTION_NONE, STATE_DCS_PASSTHROUGH);
+
+    rule(STATE_DCS_PARAM, 0x20, 0x2F, ACTION_COLLECT, STATE_DCS_INTERMEDIATE);
+    rule(STATE_DCS_PARAM, 0x30, 0x3B, ACTION_PARAM, STATE_STAY);
+    rule(STATE_DCS_PARAM, 0x3C, 0x3F, ACTION_NONE, STATE_DCS_IGNORE);
+    rule(STATE_DCS_PARAM, 0x40, 0x7E, ACTION_NONE, STATE_DCS_PASSTHROUGH);
+
+    rule(STATE_DCS_INTERMEDIATE, 0x20, 0x2F, ACTION_COLLECT, STATE_STAY);
+    rule(STATE_DCS_INTERMEDIATE, 0x30, 0x3F, ACTION_NONE, STATE_DCS_IGNORE);
+    rule(STATE_DCS_INTERMEDIATE, 0x40, 0x7E, ACTION_NONE,
+         STATE_DCS_PASSTHROUGH);
+
+    // xterm also accepts BEL as the OSC terminator
+    rule(STATE_OSC_STRING, 0x07, 0x07, ACTION_NONE, STATE_GROUND);
+    rule(STATE_OSC_STRING, 0x20, 0xFF, ACTION_OSC_PUT, STATE_STAY);
+
+    pick_scanner();
+    table_ready = true;
+}
+
+static inline void print(JTermParser *p, uint cp) {
+    if (p->ops->print)
+        p->ops->print(p->user, cp);
+}
+
+static void utf8(JTermParser *p, uchar c) {
+    if (c < 0xC0) {
+        // continuation byte
+        if (!p->utf8_left) {
+            print(p, REPLACEMENT_CHAR);
+            return;
+        }
+        p->utf8_cp = p->utf8_cp << 6 | (c & 0x3F);
+        if (--p->utf8_left == 0)
+            print(p, p->utf8_cp);
+        return;
+    }
+
+    if (p->utf8_left) {
+        // truncated sequence
+        print(p, REPLACEMENT_CHAR);
+        p->utf8_left = 0;
+    }
+
+    if (c >= 0xC2 && c < 0xE0) {
+        p->utf8_cp = c & 0x1F;
+        p->utf8_left = 1;
+    } else if (c >= 0xE0 && c < 0xF0) {
+        p->utf8_cp = c & 0x0F;
+        p->utf8_left = 2;
+    } else if (c >= 0xF0 && c < 0xF5) {
+        p->utf8_cp = c & 0x07;
+        p->utf8_left = 3;
+    } else {
+        print(p, REPLACEMENT_CHAR);
+    }
+}
+
+static void clear(JTermParser *p) {
+    p->nparams = 0;
+    p->nintermediates = 0;
+    p->overflow = false;
+}
+
+static void collect(JTermParser *p, uchar c) {
+    if (p->nintermediates < PARSER_MAX_INTERMEDIATES)
+        p->intermediates[p->nintermediates++] = c;
+    else
+        p->overflow = true;
+}
+
+static void param(JTermParser *p, uchar c) {
+    if (p->nparams == 0)
+        p->params[p->nparams++] = 0;
+
+    if (c == ';' || c == ':') {
+        if (p->nparams < PARSER_MAX_PARAMS)
+            p->params[p->nparams++] = 0;
+        else
+            p->overflow = true;
+        return;
+    }
+
+    if (p->overflow)
+        return;
+    int *v = &p->params[p->nparams - 1];
+    // clamp instead of overflowing on absurd parameters
+    *v = MIN(*v * 10 + (c - '0'), 0xFFFF);
+}
+
+static void osc_put(JTermParser *p, uchar c) {
+    if (p->osc_len < PARSER_MAX_OSC)
+        p->osc[p->osc_len++] = c;
+}
+
+static void osc_end(JTermParser *p) {
+    p->osc[p->osc_len] = '\0';
+    if (p->ops->osc_dispatch)
+        p->ops->osc_dispatch(p->user, p);
+}
+
+static void do_action(JTermParser *p, uint action, uchar c) {
+    if (p->utf8_left && action != ACTION_UTF8) {
+        print(p, REPLACEMENT_CHAR);
+        p->utf8_left = 0;
+    }
+
+    switch (action) {
+    case ACTION_PRINT:
+        print(p, c);
+        break;
+    case ACTION_UTF8:
+        utf8(p, c);
+        break;
+    case ACTION_EXECUTE:
+        if (p->ops->execute)
+            p->ops->execute(p->user, c);
+        break;
+    case ACTION_CLEAR:
+        clear(p);
+        break;
+    case ACTION_COLLECT:
+        collect(p, c);
+        break;
+    case ACTION_PARAM:
+        param(p, c);
+        break;
+    case ACTION_ESC_DISPATCH:
+        PROBE1(esc, c);
+        if (p->ops->esc_dispatch)
+            p->ops->esc_dispatch(p->user, p, c);
+        break;
+    case ACTION_CSI_DISPATCH:
+        PROBE2(csi, c, p->nparams);
+        if (p->ops->csi_dispatch)
+            p->ops->csi_dispatch(p->user, p, c);
+        break;
+    case ACTION_OSC_START:
+        p->osc_len = 0;
+        break;
+    case ACTION_OSC_PUT:
+        osc_put(p, c);
+        break;
+    case ACTION_OSC_END:
+        osc_end(p);
+        break;
+    default:
+        break;
+    }
+}
+
+static void transition(JTermParser *p, uint action, uint next, uchar c) {
+    // exit action of the state we leave
+    if (p->state == STATE_OSC_STRING)
+        do_action(p, ACTION_OSC_END, 0);
+
+    do_action(p, action, c);
+    p->state = next;
+
+    // entry action of the state we enter
+    switch (next) {
+    case STATE_ESCAPE:
+    case STATE_CSI_ENTRY:
+    case STATE_DCS_ENTRY:
+        clear(p);
+        break;
+    case STATE_OSC_STRING:
+        do_action(p, ACTION_OSC_START, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+void parser_init(JTermParser *p, const JTermParserOps *ops, void *user) {
+    if (!table_ready)
+        build_table();
+
+    memset(p, 0, sizeof(*p));
+    p->state = STATE_GROUND;
+    p->ops = ops;
+    p->user = user;
+}
+
+void parser_feed(JTermParser *p, const uchar *buf, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (p->state == STATE_GROUND && !p->utf8_left && p->ops->print_run &&
+            printable(buf[i])) {
+            size_t run = scan_printable(&buf[i], n - i);
+            p->ops->print_run(p->user, &buf[i], run);
+            i += run;
+            if (i == n)
+                break;
+        }
+
+        uchar c = buf[i];
+        uchar t = table[p->state][c];
+        uint action = t >> 4, next = t & 0xF;
+
+        if (next == STATE_STAY)
+            do_action(p, action, c);
+        else
+            transition(p, action, next, c);
+    }
+}
+
+int parser_param(const JTermParser *p, uint i, int def) {
+    if (i >= p->nparams || p->params[i] == 0)
+        return def;
+    return p->params[i];
+}
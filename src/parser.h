@@ -0,0 +1,61 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* DEC compatible escape sequence parser, after Paul Williams' VT500
+ * state machine (https://vt100.net/emu/dec_ansi_parser). Bytes go in,
+ * print/execute/dispatch callbacks come out; nothing is buffered apart
+ * from the params of the sequence currently being parsed. Ground state
+ * additionally decodes UTF-8.
+ *
+ * All of that state lives in JTermParser, so a stream can be split at any
+ * byte, even inside a sequence or a UTF-8 character, across parser_feed()
+ * calls with identical results. */
+
+#define PARSER_MAX_PARAMS 16
+#define PARSER_MAX_INTERMEDIATES 2
+#define PARSER_MAX_OSC 512
+
+typedef struct JTermParser JTermParser;
+
+typedef struct {
+    void (*print)(void *user, uint cp);
+    // optional, a run of printable ASCII (0x20-0x7E) in ground state
+    void (*print_run)(void *user, const uchar *run, size_t n);
+    void (*execute)(void *user, uchar c);
+    void (*esc_dispatch)(void *user, JTermParser *p, uchar final);
+    void (*csi_dispatch)(void *user, JTermParser *p, uchar final);
+    void (*osc_dispatch)(void *user, JTermParser *p);
+} JTermParserOps;
+
+struct JTermParser {
+    uchar state;
+
+    // params of the current CSI/DCS, a missing param is 0
+    int params[PARSER_MAX_PARAMS];
+    uint nparams;
+    // private markers (?, >, ...) and intermediates, in order of arrival
+    uchar intermediates[PARSER_MAX_INTERMEDIATES];
+    uint nintermediates;
+    bool overflow;
+
+    char osc[PARSER_MAX_OSC + 1];
+    uint osc_len;
+
+    uint utf8_cp;
+    uint utf8_left;
+
+    const JTermParserOps *ops;
+    void *user;
+};
+
+void parser_init(JTermParser *p, const JTermParserOps *ops, void *user);
+void parser_feed(JTermParser *p, const uchar *buf, size_t n);
+
+// Param i, or def when it is missing or 0.
+int parser_param(const JTermParser *p, uint i, int def);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/* USDT probes for tracing a running jterm, e.g.
+ *
+ *   bpftrace -e 'usdt:./jterm:jterm:pty_read { @[arg0] = hist(arg1); }'
+ *   bpftrace -e 'usdt:./jterm:jterm:csi { @[arg0] = count(); }' -p PID
+ *
+ * Probes in the binary are a nop each until a tracer attaches. They are
+ * built in when the compiler finds <sys/sdt.h> (systemtap-sdt-dev, or
+ * the one bundled with bcc), otherwise they compile to nothing. Define
+ * JTERM_NO_PROBES to leave them out regardless.
+ *
+ *   pty_read     fd, bytes            reader thread, each read() of master
+ *   input_write  fd, bytes            input written to master
+ *   csi          final byte, params   CSI sequence dispatched
+ *   esc          final byte           ESC sequence dispatched
+ *   scroll       top, bottom          rows top to bottom - 1 scrolled
+ *   resize       columns, rows
+ *   frame_begin                       the draw starts, after any idle wait
+ *   frame_end    rows rebuilt         after sg_commit()
+ */
+
+#if !defined(JTERM_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define JTERM_PROBES
+#endif
+#endif
+
+#ifdef JTERM_PROBES
+#include <sys/sdt.h>
+#define PROBE0(name) DTRACE_PROBE(jterm, name)
+#define PROBE1(name, a) DTRACE_PROBE1(jterm, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(jterm, name, a, b)
+#else
+#define PROBE0(name) ((void)0)
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#endif
+
+#endif
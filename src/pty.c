@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "probes.h"
+#include "pty.h"
+
+// chunks handed to one writev()
+#define INPUT_IOV 64
+
+void pt_pair(PTY *pty) {
+    char *slave_name;
+
+    // Opens the PTY master device.
+    pty->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty->master == -1) {
+        ERROR("posix_openpt");
+    }
+    /* grantpt() and unlockpt() are housekeeping functions that have to
+     * be called before we can open the slave FD. Refer to the manpages
+     * on what they do. */
+    if (grantpt(pty->master) == -1) {
+        perror("grantpt");
+    }
+
+    if (unlockpt(pty->master) == -1) {
+        ERROR("unlockpt");
+    }
+
+    /* Up until now, we only have the master FD. We also need a file
+     * descriptor for our child process. We get it by asking for the
+     * actual path in /dev/pts which we then open using a regular
+     * ope(). So, unlike pipe(), you don't get two corresponding file
+     * descriptors in one go. */
+    slave_name = ptsname(pty->master);
+    if (slave_name == NULL) {
+        ERROR("ptsname");
+    }
+
+    pty->slave = open(slave_name, O_RDWR | O_NOCTTY);
+    if (pty->slave == -1) {
+        ERROR("open(slave_name)");
+    }
+
+    /* The reader drains master until EAGAIN on every wakeup instead of
+     * doing one read() per poll. */
+    int flags = fcntl(pty->master, F_GETFL);
+    if (flags == -1 || fcntl(pty->master, F_SETFL, flags | O_NONBLOCK) == -1) {
+        ERROR("fcntl(O_NONBLOCK)");
+    }
+    pty->input = pty->input_tail = NULL;
+}
+
+/* TERM=jterm when its entry is there to be found, in front of wherever
+ * the child would look anyway. TERMINFO would hide every other entry. */
+static void set_term() {
+    const char *dirs = getenv("TERMINFO_DIRS");
+    char buf[4096];
+
+    if (!*JTERM_TERMINFO || access(JTERM_TERMINFO, R_OK) == -1) {
+        setenv("TERM", "dumb", 1);
+        return;
+    }
+    // an empty entry is the system's default location
+    snprintf(buf, sizeof(buf), "%s:%s", JTERM_TERMINFO, dirs ? dirs : "");
+    setenv("TERMINFO_DIRS", buf, 1);
+    setenv("TERM", "jterm", 1);
+}
+
+void pt_spawn(PTY *pty, const char *path, char *const argv[]) {
+    pid_t pid;
+
+    pid = fork();
+    if (pid == 0) {
+        close(pty->master);
+
+        /* Create a new session and make our terminal this process'
+           controlling terminal. */
+        setsid();
+        if (ioctl(pty->slave, TIOCSCTTY, NULL) == -1) {
+            ERROR("ioctl(TIOCSCTTY)");
+        }
+
+        // close the shell's io fd's
+        dup2(pty->slave, STDIN_FILENO);
+        dup2(pty->slave, STDOUT_FILENO);
+        dup2(pty->slave, STDERR_FILENO);
+        close(pty->slave);
+
+        set_term();
+        execvp(path, argv);
+        ERROR("could not execute %s", path);
+    } else if (pid > 0) {
+        close(pty->slave);
+        return;
+    }
+
+    ERROR("fork");
+}
+
+void spawn_shell(PTY *pty) {
+    // a leading dash makes it a login shell
+    char *argv[] = {"-" SHELL, NULL};
+    pt_spawn(pty, SHELL, argv);
+}
+
+//---Reader thread---
+static void notify(PTY *pty) {
+    // one byte in the pipe is enough until the renderer re-arms
+    if (__atomic_exchange_n(&pty->wake_pending, 1, __ATOMIC_SEQ_CST))
+        return;
+    uchar b = 0;
+    while (write(pty->wakeup[1], &b, 1) == -1 && errno == EINTR)
+        ;
+}
+
+static void wait_for_space(PTY *pty) {
+    uchar *span;
+
+    pthread_mutex_lock(&pty->lock);
+    __atomic_store_n(&pty->reader_waiting, 1, __ATOMIC_SEQ_CST);
+    /* Re-check under the lock: pt_consume() looks at reader_waiting
+     * after moving tail, so either we see the space here or it sees us
+     * waiting and signals. */
+    while (ring_write_span(&pty->ring, &span) == 0)
+        pthread_cond_wait(&pty->space, &pty->lock);
+    __atomic_store_n(&pty->reader_waiting, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pty->lock);
+}
+
+// Returns false once the child has hung up.
+static bool drain(PTY *pty) {
+    for (;;) {
+        uchar *span;
+        size_t space = ring_write_span(&pty->ring, &span);
+        if (space == 0) {
+            // renderer is behind, let the shell block on a full PTY
+            wait_for_space(pty);
+            continue;
+        }
+
+        // reads go straight into the ring, as much as it can take
+        ssize_t n = read(pty->master, span, space);
+        PROBE2(pty_read, pty->master, n);
+        if (n > 0) {
+            ring_commit(&pty->ring, n);
+            __atomic_fetch_add(&pty->bytes_read, n, __ATOMIC_RELAXED);
+            notify(pty);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        // child exit (Linux reports EIO once the slave is gone)
+        if (n < 0 && errno != EIO)
+            perror("read(master)");
+        return false;
+    }
+}
+
+static void *reader_main(void *arg) {
+    PTY *pty = arg;
+    struct pollfd pfd = {.fd = pty->master, .events = POLLIN};
+
+    for (;;) {
+        if (poll(&pfd, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            ERROR("poll");
+        }
+
+        if (!drain(pty)) {
+            __atomic_store_n(&pty->closed, 1, __ATOMIC_RELEASE);
+            notify(pty);
+            return NULL;
+        }
+    }
+}
+
+void pt_start_reader(PTY *pty) {
+    ring_init(&pty->ring, PTY_RING_SIZE);
+    pthread_mutex_init(&pty->lock, NULL);
+    pthread_cond_init(&pty->space, NULL);
+    pty->reader_waiting = 0;
+    pty->closed = 0;
+    pty->bytes_read = 0;
+    if (pipe2(pty->wakeup, O_NONBLOCK | O_CLOEXEC) == -1) {
+        ERROR("pipe2");
+    }
+    pty->wake_pending = 0;
+
+    if (pthread_create(&pty->reader, NULL, reader_main, pty) != 0) {
+        ERROR("pthread_create(reader)");
+    }
+    pthread_detach(pty->reader);
+}
+
+void pt_consume(PTY *pty, size_t n) {
+    ring_consume(&pty->ring, n);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pty->reader_waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&pty->lock);
+        pthread_cond_signal(&pty->space);
+        pthread_mutex_unlock(&pty->lock);
+    }
+}
+
+void pt_arm_wakeup(PTY *pty) {
+    uchar buf[64];
+
+    // clear the flag first, a notify() racing with the drain still writes
+    __atomic_store_n(&pty->wake_pending, 0, __ATOMIC_SEQ_CST);
+    while (read(pty->wakeup[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+bool pt_finished(PTY *pty) {
+    return __atomic_load_n(&pty->closed, __ATOMIC_ACQUIRE) &&
+           ring_used(&pty->ring) == 0;
+}
+
+//---Input---
+void pt_queue_input(PTY *pty, const void *buf, size_t n) {
+    const uchar *src = buf;
+
+    // keys typed between flushes pile up in the tail and go out together
+    while (n) {
+        JTermInputChunk *tail = pty->input_tail;
+        if (!tail || tail->end == PTY_INPUT_CHUNK) {
+            JTermInputChunk *c = malloc(sizeof(*c));
+            if (!c) {
+                ERROR("out of memory");
+            }
+            c->next = NULL;
+            c->start = c->end = 0;
+            if (tail)
+                tail->next = c;
+            else
+                pty->input = c;
+            pty->input_tail = tail = c;
+        }
+
+        size_t k = MIN(n, PTY_INPUT_CHUNK - tail->end);
+        memcpy(&tail->data[tail->end], src, k);
+        tail->end += k;
+        src += k;
+        n -= k;
+    }
+}
+
+// Drop n written bytes from the front, keeping the last chunk for reuse.
+static void input_consume(PTY *pty, size_t n) {
+    while (pty->input) {
+        JTermInputChunk *c = pty->input;
+        size_t k = MIN(n, c->end - c->start);
+        c->start += k;
+        n -= k;
+        if (c->start != c->end)
+            return;
+        if (!c->next) {
+            c->start = c->end = 0;
+            return;
+        }
+        pty->input = c->next;
+        free(c);
+    }
+}
+
+bool pt_flush_input(PTY *pty) {
+    while (pt_input_pending(pty)) {
+        struct iovec iov[INPUT_IOV];
+        size_t total = 0;
+        int n = 0;
+        for (JTermInputChunk *c = pty->input; c && n < INPUT_IOV; c = c->next) {
+            iov[n++] = (struct iovec){&c->data[c->start], c->end - c->start};
+            total += c->end - c->start;
+        }
+
+        ssize_t written = writev(pty->master, iov, n);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            // the child is gone, nobody will read the rest
+            if (errno != EIO)
+                perror("writev(master)");
+            input_consume(pty, SIZE_MAX);
+            return true;
+        }
+        PROBE2(input_write, pty->master, written);
+        input_consume(pty, written);
+        if ((size_t)written < total)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef PTY_H
+#define PTY_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "ring.h"
+
+#define SHELL "/bin/sh"
+
+/* Directory jterm.ti was compiled into, build.sh sets it. Without it
+ * programs get TERM=dumb. */
+#ifndef JTERM_TERMINFO
+#define JTERM_TERMINFO ""
+#endif
+
+// Bytes the reader thread may run ahead of the renderer.
+#define PTY_RING_SIZE (1 << 20)
+
+#define PTY_INPUT_CHUNK 4096
+
+// A piece of the input queue, data[start, end) is still to be written.
+typedef struct JTermInputChunk {
+    struct JTermInputChunk *next;
+    size_t start, end;
+    uchar data[PTY_INPUT_CHUNK];
+} JTermInputChunk;
+
+typedef struct {
+    int master, slave;
+
+    /* The reader thread is the only thing that read()s from master. It
+     * fills ring, and the render thread drains it with pt_consume(). */
+    JTermRing ring;
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t space;
+    int reader_waiting;
+    int closed;
+
+    /* Becomes readable when the reader committed bytes or hit EOF, so the
+     * renderer can sleep in poll() while the shell is quiet. */
+    int wakeup[2];
+    int wake_pending;
+
+    // total bytes pulled off master, for throughput reporting
+    ulong bytes_read;
+
+    /* Keys, pastes and replies for the child, oldest first. Only the
+     * render thread touches it. Writes never block, what master doesn't
+     * take stays queued for the next flush. */
+    JTermInputChunk *input, *input_tail;
+} PTY;
+
+// master is non-blocking, readers must be ready for EAGAIN
+void pt_pair(PTY *pty);
+void spawn_shell(PTY *pty);
+// Run path with argv on the slave side instead of the shell.
+void pt_spawn(PTY *pty, const char *path, char *const argv[]);
+
+void pt_start_reader(PTY *pty);
+// Release n bytes of the span returned by ring_read_span(&pty->ring, ...)
+void pt_consume(PTY *pty, size_t n);
+/* Call before checking the ring and going to sleep on wakeup[0]: any
+ * bytes that arrive after this make wakeup[0] readable. */
+void pt_arm_wakeup(PTY *pty);
+// True once the child hung up and everything it wrote has been consumed.
+bool pt_finished(PTY *pty);
+
+// Queue bytes for the child, they are written by pt_flush_input().
+void pt_queue_input(PTY *pty, const void *buf, size_t n);
+/* Write as much of the queue as master takes without blocking, in one
+ * writev() if it can. True once the queue is empty; otherwise wait for
+ * master to be writable (POLLOUT) and flush again. */
+bool pt_flush_input(PTY *pty);
+
+static inline bool pt_input_pending(const PTY *pty) {
+    return pty->input && pty->input->start != pty->input->end;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "record.h"
+
+#define MAGIC_LEN (sizeof(RECORD_MAGIC) - 1)
+
+//---Recording---
+static void put_varint(FILE *f, ulong v) {
+    while (v >= 0x80) {
+        fputc(v | 0x80, f);
+        v >>= 7;
+    }
+    fputc(v, f);
+}
+
+// type and time, the start of every record
+static void put_header(JTermRecorder *r, uchar type) {
+    ulong us = (now_seconds() - r->last) * 1e6;
+    fputc(type, r->f);
+    put_varint(r->f, us);
+    // advance by what was written so rounding doesn't add up
+    r->last += us / 1e6;
+}
+
+bool record_open(JTermRecorder *r, const char *path, uint w, uint h) {
+    r->f = fopen(path, "wb");
+    if (!r->f)
+        return false;
+    r->last = now_seconds();
+    fwrite(RECORD_MAGIC, 1, MAGIC_LEN, r->f);
+    put_varint(r->f, w);
+    put_varint(r->f, h);
+    return true;
+}
+
+void record_close(JTermRecorder *r) {
+    if (!r->f)
+        return;
+    if (fclose(r->f) == EOF)
+        WARN("record: the recording may be incomplete");
+    r->f = NULL;
+}
+
+static void put_bytes(JTermRecorder *r, uchar type, const uchar *buf,
+                      size_t n) {
+    if (!r->f)
+        return;
+    put_header(r, type);
+    put_varint(r->f, n);
+    fwrite(buf, 1, n, r->f);
+}
+
+void record_output(JTermRecorder *r, const uchar *buf, size_t n) {
+    put_bytes(r, RECORD_OUTPUT, buf, n);
+}
+
+void record_input(JTermRecorder *r, const uchar *buf, size_t n) {
+    put_bytes(r, RECORD_INPUT, buf, n);
+}
+
+void record_resize(JTermRecorder *r, uint w, uint h) {
+    if (!r->f)
+        return;
+    put_header(r, RECORD_RESIZE);
+    put_varint(r->f, w);
+    put_varint(r->f, h);
+}
+
+//---Replay---
+// False if the file ends in the middle of the number.
+static bool get_varint(JTermReplay *p, ulong *v) {
+    uint shift = 0;
+    *v = 0;
+    while (p->pos < p->size && shift < 64) {
+        uchar b = p->map[p->pos++];
+        *v |= (ulong)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+        shift += 7;
+    }
+    return false;
+}
+
+bool replay_open(JTermReplay *p, const char *path) {
+    struct stat st;
+    ulong w, h;
+
+    memset(p, 0, sizeof(*p));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < MAGIC_LEN) {
+        close(fd);
+        return false;
+    }
+    p->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p->map == MAP_FAILED) {
+        p->map = NULL;
+        return false;
+    }
+    p->size = st.st_size;
+    madvise(p->map, p->size, MADV_SEQUENTIAL);
+
+    p->pos = MAGIC_LEN;
+    if (memcmp(p->map, RECORD_MAGIC, MAGIC_LEN) || !get_varint(p, &w) ||
+        !get_varint(p, &h)) {
+        replay_close(p);
+        return false;
+    }
+    p->w = w;
+    p->h = h;
+    return true;
+}
+
+void replay_close(JTermReplay *p) {
+    if (p->map)
+        munmap(p->map, p->size);
+    p->map = NULL;
+}
+
+bool replay_next(JTermReplay *p, JTermRecord *rec) {
+    ulong dt, a, b;
+
+    if (p->pos >= p->size)
+        return false;
+    rec->type = p->map[p->pos++];
+    if (!get_varint(p, &dt))
+        return false;
+    p->time += dt / 1e6;
+    rec->time = p->time;
+
+    switch (rec->type) {
+    case RECORD_OUTPUT:
+    case RECORD_INPUT:
+        if (!get_varint(p, &a) || a > p->size - p->pos)
+            return false;
+        rec->data = &p->map[p->pos];
+        rec->len = a;
+        p->pos += a;
+        return true;
+    case RECORD_RESIZE:
+        if (!get_varint(p, &a) || !get_varint(p, &b))
+            return false;
+        rec->w = a;
+        rec->h = b;
+        return true;
+    default:
+        WARN("replay: unknown record type %u", rec->type);
+        return false;
+    }
+}
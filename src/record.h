@@ -0,0 +1,62 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Session recordings: everything that reached the terminal, with when it
+ * happened, so a slow case can be replayed without the shell that caused
+ * it.
+ *
+ * A file is RECORD_MAGIC, varint width and height, then records of
+ *   byte type, varint microseconds since the previous record,
+ *   RECORD_OUTPUT/RECORD_INPUT: varint length, bytes
+ *   RECORD_RESIZE: varint width, varint height
+ */
+
+#define RECORD_MAGIC "JTRM\1"
+
+enum {
+    RECORD_OUTPUT = 1, // bytes from the PTY, as read_pty() fed them
+    RECORD_INPUT,      // bytes written to the PTY
+    RECORD_RESIZE,
+};
+
+typedef struct {
+    FILE *f;
+    // time of the last record
+    double last;
+} JTermRecorder;
+
+typedef struct {
+    uchar type;
+    // seconds since the recording started
+    double time;
+    const uchar *data;
+    size_t len;
+    uint w, h;
+} JTermRecord;
+
+typedef struct {
+    uchar *map;
+    size_t size, pos;
+    double time;
+    // screen size when recording started
+    uint w, h;
+} JTermReplay;
+
+bool record_open(JTermRecorder *r, const char *path, uint w, uint h);
+void record_close(JTermRecorder *r);
+void record_output(JTermRecorder *r, const uchar *buf, size_t n);
+void record_input(JTermRecorder *r, const uchar *buf, size_t n);
+void record_resize(JTermRecorder *r, uint w, uint h);
+
+// False if path can't be read or isn't a recording.
+bool replay_open(JTermReplay *p, const char *path);
+void replay_close(JTermReplay *p);
+/* The next record, false at the end. data points into the mapped file and
+ * stays valid until replay_close(). */
+bool replay_next(JTermReplay *p, JTermRecord *rec);
+
+#endif
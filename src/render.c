@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+
+#include "ext/sokol_debugtext.h"
+
+#define GLYPH_PIXELS 8
+#define ATLAS_WIDTH (256 * GLYPH_PIXELS)
+#define ATLAS_HEIGHT (RENDER_FONTS * GLYPH_PIXELS)
+
+// Uniforms, all vec4 so GLSL and MSL agree on the layout:
+//   [0]  cell size in clip space, columns, unused
+//   [1]  font, fonts in the atlas, unused, unused
+//   [2]  cursor x, y, visible, screen row of the first instance
+// the shaders spell the count out
+#define PARAMS_COUNT 3
+
+typedef struct {
+    float v[PARAMS_COUNT][4];
+} JTermParams;
+
+/* Glyph pixels come from the atlas at local * 8. Bold doubles each
+ * stroke one pixel to the right, italic shifts the top half of the glyph
+ * one pixel right, underline and strike are whole pixel rows. The attrs
+ * bits are the ATTR_* flags. */
+
+//---Shaders---
+#if defined(SOKOL_METAL) || defined(__APPLE__)
+static const char *vs_source =
+    "#include <metal_stdlib>\n"
+    "using namespace metal;\n"
+    "struct params_t { float4 p[3]; };\n"
+    "struct vs_in {\n"
+    "    uint4 glyph_fg [[attribute(0)]];\n"
+    "    uint4 attrs_bg [[attribute(1)]];\n"
+    "};\n"
+    "struct vs_out {\n"
+    "    float4 pos [[position]];\n"
+    "    float2 local;\n"
+    "    float2 origin [[flat]];\n"
+    "    float2 scale [[flat]];\n"
+    "    float4 fg [[flat]];\n"
+    "    float4 bg [[flat]];\n"
+    "    uint attrs [[flat]];\n"
+    "};\n"
+    "constant float2 corners[6] = {\n"
+    "    float2(0, 0), float2(1, 0), float2(1, 1),\n"
+    "    float2(0, 0), float2(1, 1), float2(0, 1),\n"
+    "};\n"
+    "vertex vs_out vs_main(vs_in in [[stage_in]],\n"
+    "                      constant params_t &params [[buffer(0)]],\n"
+    "                      uint vid [[vertex_id]],\n"
+    "                      uint iid [[instance_id]]) {\n"
+    "    float4 p0 = params.p[0], p1 = params.p[1], p2 = params.p[2];\n"
+    "    uint w = uint(p0.z);\n"
+    "    uint col = iid % w, y = iid / w + uint(p2.w);\n"
+    "    float2 c = corners[vid];\n"
+    "    vs_out out;\n"
+    "    out.pos = float4(-1.0 + (float(col) + c.x) * p0.x,\n"
+    "                     1.0 - (float(y) + c.y) * p0.y, 0.0, 1.0);\n"
+    "    out.local = c;\n"
+    "    out.origin = float2(float(in.glyph_fg.x) / 256.0, p1.x / p1.y);\n"
+    "    out.scale = float2(1.0 / 256.0, 1.0 / p1.y) / 8.0;\n"
+    "    float4 fg = float4(float3(in.glyph_fg.yzw) / 255.0, 1.0);\n"
+    "    float4 bg = float4(float3(in.attrs_bg.yzw) / 255.0, 1.0);\n"
+    "    bool cursor = p2.z > 0.0 && col == uint(p2.x) && y == uint(p2.y);\n"
+    "    out.fg = cursor ? bg : fg;\n"
+    "    out.bg = cursor ? fg : bg;\n"
+    "    out.attrs = in.attrs_bg.x;\n"
+    "    return out;\n"
+    "}\n";
+static const char *fs_source =
+    "#include <metal_stdlib>\n"
+    "using namespace metal;\n"
+    "struct vs_out {\n"
+    "    float4 pos [[position]];\n"
+    "    float2 local;\n"
+    "    float2 origin [[flat]];\n"
+    "    float2 scale [[flat]];\n"
+    "    float4 fg [[flat]];\n"
+    "    float4 bg [[flat]];\n"
+    "    uint attrs [[flat]];\n"
+    "};\n"
+    "float ink(vs_out in, texture2d<float> tex, sampler smp, float2 px) {\n"
+    "    if (px.x < 0.0)\n"
+    "        return 0.0;\n"
+    "    return tex.sample(smp, in.origin + px * in.scale).r;\n"
+    "}\n"
+    "fragment float4 fs_main(vs_out in [[stage_in]],\n"
+    "                        texture2d<float> tex [[texture(0)]],\n"
+    "                        sampler smp [[sampler(0)]]) {\n"
+    "    float2 px = in.local * 8.0;\n"
+    "    if ((in.attrs & 16) != 0 && in.local.y < 0.5)\n"
+    "        px.x -= 1.0;\n"
+    "    float v = ink(in, tex, smp, px);\n"
+    "    if ((in.attrs & 1) != 0)\n"
+    "        v = max(v, ink(in, tex, smp, px - float2(1.0, 0.0)));\n"
+    "    if ((in.attrs & 2) != 0 && in.local.y > 0.875)\n"
+    "        v = 1.0;\n"
+    "    if ((in.attrs & 64) != 0 && in.local.y > 0.375 && in.local.y < 0.5)\n"
+    "        v = 1.0;\n"
+    "    return mix(in.bg, in.fg, v);\n"
+    "}\n";
+#else
+static const char *vs_source =
+    "#version 410\n"
+    "uniform vec4 params[3];\n"
+    "layout(location = 0) in uvec4 glyph_fg;\n"
+    "layout(location = 1) in uvec4 attrs_bg;\n"
+    "out vec2 local;\n"
+    "flat out vec2 origin;\n"
+    "flat out vec2 scale;\n"
+    "flat out vec4 fg;\n"
+    "flat out vec4 bg;\n"
+    "flat out uint attrs;\n"
+    "const vec2 corners[6] = vec2[6](\n"
+    "    vec2(0, 0), vec2(1, 0), vec2(1, 1),\n"
+    "    vec2(0, 0), vec2(1, 1), vec2(0, 1));\n"
+    "void main() {\n"
+    "    vec4 p0 = params[0], p1 = params[1], p2 = params[2];\n"
+    "    uint w = uint(p0.z);\n"
+    "    uint id = uint(gl_InstanceID);\n"
+    "    uint col = id % w, y = id / w + uint(p2.w);\n"
+    "    vec2 c = corners[gl_VertexID];\n"
+    "    gl_Position = vec4(-1.0 + (float(col) + c.x) * p0.x,\n"
+    "                       1.0 - (float(y) + c.y) * p0.y, 0.0, 1.0);\n"
+    "    local = c;\n"
+    "    origin = vec2(float(glyph_fg.x) / 256.0, p1.x / p1.y);\n"
+    "    scale = vec2(1.0 / 256.0, 1.0 / p1.y) / 8.0;\n"
+    "    vec4 f = vec4(vec3(glyph_fg.yzw) / 255.0, 1.0);\n"
+    "    vec4 b = vec4(vec3(attrs_bg.yzw) / 255.0, 1.0);\n"
+    "    bool cursor = p2.z > 0.0 && col == uint(p2.x) && y == uint(p2.y);\n"
+    "    fg = cursor ? b : f;\n"
+    "    bg = cursor ? f : b;\n"
+    "    attrs = attrs_bg.x;\n"
+    "}\n";
+static const char *fs_source =
+    "#version 410\n"
+    "uniform sampler2D tex_smp;\n"
+    "in vec2 local;\n"
+    "flat in vec2 origin;\n"
+    "flat in vec2 scale;\n"
+    "flat in vec4 fg;\n"
+    "flat in vec4 bg;\n"
+    "flat in uint attrs;\n"
+    "out vec4 frag_color;\n"
+    "float ink(vec2 px) {\n"
+    "    if (px.x < 0.0)\n"
+    "        return 0.0;\n"
+    "    return texture(tex_smp, origin + px * scale).r;\n"
+    "}\n"
+    "void main() {\n"
+    "    vec2 px = local * 8.0;\n"
+    "    if ((attrs & 16u) != 0u && local.y < 0.5)\n"
+    "        px.x -= 1.0;\n"
+    "    float v = ink(px);\n"
+    "    if ((attrs & 1u) != 0u)\n"
+    "        v = max(v, ink(px - vec2(1.0, 0.0)));\n"
+    "    if ((attrs & 2u) != 0u && local.y > 0.875)\n"
+    "        v = 1.0;\n"
+    "    if ((attrs & 64u) != 0u && local.y > 0.375 && local.y < 0.5)\n"
+    "        v = 1.0;\n"
+    "    frag_color = mix(bg, fg, v);\n"
+    "}\n";
+#endif
+//-------------------
+
+// 1 bit per pixel, 8 bytes per glyph, into row font of the atlas
+static void unpack_font(const sdtx_font_desc_t *font, uint row, uchar *atlas) {
+    const uchar *bits = font->data.ptr;
+
+    for (uint c = font->first_char; c <= font->last_char; c++) {
+        for (uint y = 0; y < GLYPH_PIXELS; y++, bits++) {
+            uchar *out = &atlas[(row * GLYPH_PIXELS + y) * ATLAS_WIDTH +
+                                c * GLYPH_PIXELS];
+            for (uint x = 0; x < GLYPH_PIXELS; x++)
+                out[x] = (*bits >> (7 - x) & 1) ? 0xFF : 0x00;
+        }
+    }
+}
+
+void render_init(JTermRenderer *r) {
+    memset(r, 0, sizeof(*r));
+    cells_init(&r->cells);
+
+    static uchar pixels[ATLAS_WIDTH * ATLAS_HEIGHT];
+    const sdtx_font_desc_t fonts[RENDER_FONTS] = {
+        sdtx_font_cpc(),
+        sdtx_font_oric(),
+    };
+    for (uint i = 0; i < RENDER_FONTS; i++)
+        unpack_font(&fonts[i], i, pixels);
+
+    r->atlas = sg_make_image(&(sg_image_desc){
+        .width = ATLAS_WIDTH,
+        .height = ATLAS_HEIGHT,
+        .pixel_format = SG_PIXELFORMAT_R8,
+        .data.subimage[0][0] = SG_RANGE(pixels),
+        .label = "jterm-atlas",
+    });
+    r->sampler = sg_make_sampler(&(sg_sampler_desc){
+        .min_filter = SG_FILTER_NEAREST,
+        .mag_filter = SG_FILTER_NEAREST,
+        .wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+        .wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+        .label = "jterm-atlas-sampler",
+    });
+
+    r->shader = sg_make_shader(&(sg_shader_desc){
+        .vertex_func = {.source = vs_source, .entry = "vs_main"},
+        .fragment_func = {.source = fs_source, .entry = "fs_main"},
+        .attrs[0] = {.base_type = SG_SHADERATTRBASETYPE_UINT,
+                     .glsl_name = "glyph_fg"},
+        .attrs[1] = {.base_type = SG_SHADERATTRBASETYPE_UINT,
+                     .glsl_name = "attrs_bg"},
+        .uniform_blocks[0] =
+            {
+                .stage = SG_SHADERSTAGE_VERTEX,
+                .size = sizeof(JTermParams),
+                .msl_buffer_n = 0,
+                .glsl_uniforms[0] = {.type = SG_UNIFORMTYPE_FLOAT4,
+                                     .array_count = PARAMS_COUNT,
+                                     .glsl_name = "params"},
+            },
+        .images[0] = {.stage = SG_SHADERSTAGE_FRAGMENT,
+                      .image_type = SG_IMAGETYPE_2D,
+                      .sample_type = SG_IMAGESAMPLETYPE_FLOAT},
+        .samplers[0] = {.stage = SG_SHADERSTAGE_FRAGMENT,
+                        .sampler_type = SG_SAMPLERTYPE_FILTERING},
+        .image_sampler_pairs[0] = {.stage = SG_SHADERSTAGE_FRAGMENT,
+                                   .image_slot = 0,
+                                   .sampler_slot = 0,
+                                   .glsl_name = "tex_smp"},
+        .label = "jterm-cells-shader",
+    });
+
+    r->pipeline = sg_make_pipeline(&(sg_pipeline_desc){
+        .shader = r->shader,
+        .layout =
+            {
+                .buffers[0] = {.stride = sizeof(JTermCell),
+                               .step_func = SG_VERTEXSTEP_PER_INSTANCE},
+                .attrs[0] = {.format = SG_VERTEXFORMAT_UBYTE4},
+                .attrs[1] = {.format = SG_VERTEXFORMAT_UBYTE4},
+            },
+        .label = "jterm-cells",
+    });
+}
+
+void render_free(JTermRenderer *r) {
+    sg_destroy_buffer(r->buffer);
+    sg_destroy_buffer(r->patches);
+    sg_destroy_pipeline(r->pipeline);
+    sg_destroy_shader(r->shader);
+    sg_destroy_sampler(r->sampler);
+    sg_destroy_image(r->atlas);
+    cells_free(&r->cells);
+}
+
+// All cells into the buffer, which then needs no patches.
+static void upload_all(JTermRenderer *r) {
+    JTermCells *c = &r->cells;
+    size_t size = sizeof(JTermCell) * c->w * c->h * 2;
+
+    if (size > r->buffer_size) {
+        sg_destroy_buffer(r->buffer);
+        r->buffer = sg_make_buffer(&(sg_buffer_desc){
+            .size = size,
+            .usage = {.vertex_buffer = true, .dynamic_update = true},
+            .label = "jterm-cells",
+        });
+        sg_destroy_buffer(r->patches);
+        r->patches = sg_make_buffer(&(sg_buffer_desc){
+            .size = size / RENDER_PATCH_SHARE,
+            .usage = {.vertex_buffer = true, .stream_update = true},
+            .label = "jterm-cell-patches",
+        });
+        r->buffer_size = size;
+    }
+    sg_update_buffer(r->buffer,
+                     &(sg_range){c->cells, sizeof(JTermCell) * cells_count(c)});
+    memset(c->changed, 0, c->h * 2);
+    r->npatches = 0;
+}
+
+void render_update(JTermRenderer *r, JTerm *t, ulong view) {
+    JTermCells *c = &r->cells;
+    uint w = c->w, h = c->h;
+
+    cells_update(c, t, view);
+    if (c->w != w || c->h != h || !r->buffer_size) {
+        upload_all(r);
+        return;
+    }
+
+    /* Appended data only lasts a frame, so every row changed since the
+     * last full upload goes again. Once that is more than a share of the
+     * screen the full upload is cheaper from then on. */
+    uint rows = c->h + MIN(c->view, c->h), changed = 0;
+    r->npatches = 0;
+    for (uint y = 0; y < rows; y++) {
+        if (!c->changed[y])
+            continue;
+        if (!y || !c->changed[y - 1]) {
+            if (r->npatches == RENDER_MAX_PATCHES) {
+                upload_all(r);
+                return;
+            }
+            r->patch[r->npatches++] = (JTermPatch){.row = y};
+        }
+        r->patch[r->npatches - 1].rows++;
+        changed++;
+    }
+    if (changed > c->h * 2 / RENDER_PATCH_SHARE) {
+        upload_all(r);
+        return;
+    }
+    for (uint i = 0; i < r->npatches; i++) {
+        JTermPatch *p = &r->patch[i];
+        p->offset = sg_append_buffer(
+            r->patches, &(sg_range){&c->cells[p->row * c->w],
+                                    sizeof(JTermCell) * p->rows * c->w});
+    }
+}
+
+// rows rows of cells at offset in buffer, on screen from row y down
+static void draw_rows(JTermRenderer *r, JTermParams *params, sg_buffer buffer,
+                      int offset, uint y, uint rows) {
+    sg_apply_bindings(&(sg_bindings){
+        .vertex_buffers[0] = buffer,
+        .vertex_buffer_offsets[0] = offset,
+        .images[0] = r->atlas,
+        .samplers[0] = r->sampler,
+    });
+    params->v[2][3] = y;
+    sg_apply_uniforms(0, &(sg_range){params, sizeof(*params)});
+    sg_draw(0, 6, rows * r->cells.w);
+}
+
+void render_draw(JTermRenderer *r, uint font, float cell, float width,
+                 float height) {
+    JTermCells *c = &r->cells;
+    JTermParams params = {
+        .v = {
+            {2.0f * cell / width, 2.0f * cell / height, c->w, 0},
+            {font, RENDER_FONTS, 0, 0},
+            {c->cursor_x, c->cursor_y, c->cursor, 0},
+        },
+    };
+    int row_size = sizeof(JTermCell) * c->w;
+
+    sg_apply_pipeline(r->pipeline);
+    for (uint i = 0; i < c->nspans; i++) {
+        const JTermSpan *s = &c->span[i];
+        draw_rows(r, &params, r->buffer, s->row * row_size, s->y, s->rows);
+
+        // the span's changed rows on top of the stale ones
+        for (uint j = 0; j < r->npatches; j++) {
+            const JTermPatch *p = &r->patch[j];
+            uint first = MAX(s->row, p->row);
+            uint end = MIN(s->row + s->rows, p->row + p->rows);
+            if (first < end)
+                draw_rows(r, &params, r->patches,
+                          p->offset + (first - p->row) * row_size,
+                          s->y + first - s->row, end - first);
+        }
+    }
+}
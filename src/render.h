@@ -0,0 +1,56 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "cells.h"
+#include "common.h"
+#include "ext/sokol_gfx.h"
+#include "term.h"
+
+// the debugtext fonts packed into the atlas, cpc then oric
+#define RENDER_FONTS 2
+
+// DEFAULT_BG_RGB as a clear colour
+#define BACKGROUND_RGBA {0x18 / 255.0f, 0x18 / 255.0f, 0x18 / 255.0f, 1.0f}
+
+// runs of changed rows drawn over the cell buffer, more upload it all
+#define RENDER_MAX_PATCHES 32
+/* Changed rows are patched while they are at most 1/RENDER_PATCH_SHARE of
+ * all rows, the patch buffer's size. */
+#define RENDER_PATCH_SHARE 4
+
+// Rows [row, row + rows) of the cells, at offset in the patch buffer.
+typedef struct {
+    int offset;
+    uint row, rows;
+} JTermPatch;
+
+/* Draws the terminal with one instanced draw call per span of the cells.
+ * The cell buffer is uploaded whole only now and then; rows changed since
+ * are appended to a stream buffer every frame and drawn over it, one draw
+ * per run of rows in a span, so a frame uploads about as much as
+ * changed. */
+typedef struct {
+    sg_shader shader;
+    sg_pipeline pipeline;
+    sg_image atlas;
+    sg_sampler sampler;
+    sg_buffer buffer;
+    size_t buffer_size;
+    sg_buffer patches;
+    JTermPatch patch[RENDER_MAX_PATCHES];
+    uint npatches;
+
+    JTermCells cells;
+} JTermRenderer;
+
+void render_init(JTermRenderer *r);
+void render_free(JTermRenderer *r);
+/* Bring the instances up to date with the terminal, scrolled view lines
+ * back into history. Call outside of a pass, exactly once in every frame
+ * that draws; patches only last the frame they were appended in. */
+void render_update(JTermRenderer *r, JTerm *t, ulong view);
+// cell is the size of a cell in framebuffer pixels
+void render_draw(JTermRenderer *r, uint font, float cell, float width,
+                 float height);
+
+#endif
@@ -0,0 +1,58 @@
+#include <stdlib.h>
+
+#include "ring.h"
+
+void ring_init(JTermRing *ring, size_t size) {
+    // round up to a power of two so indices can simply be masked
+    size_t cap = 1;
+    while (cap < size)
+        cap <<= 1;
+
+    ring->data = malloc(cap);
+    if (!ring->data) {
+        ERROR("ring_init: out of memory");
+    }
+    ring->mask = cap - 1;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+void ring_free(JTermRing *ring) {
+    free(ring->data);
+    ring->data = NULL;
+}
+
+size_t ring_write_span(JTermRing *ring, uchar **span) {
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t cap = ring->mask + 1;
+    size_t free = cap - (head - tail);
+    size_t until_wrap = cap - (head & ring->mask);
+
+    *span = &ring->data[head & ring->mask];
+    return MIN(free, until_wrap);
+}
+
+void ring_commit(JTermRing *ring, size_t n) {
+    __atomic_store_n(&ring->head, ring->head + n, __ATOMIC_RELEASE);
+}
+
+size_t ring_read_span(JTermRing *ring, uchar **span) {
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t cap = ring->mask + 1;
+    size_t used = head - tail;
+    size_t until_wrap = cap - (tail & ring->mask);
+
+    *span = &ring->data[tail & ring->mask];
+    return MIN(used, until_wrap);
+}
+
+void ring_consume(JTermRing *ring, size_t n) {
+    __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+}
+
+size_t ring_used(JTermRing *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,33 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Single-producer/single-consumer byte ring. head and tail only ever
+ * grow and are masked on access, so full and empty are never ambiguous.
+ * The producer only stores head and the consumer only stores tail; each
+ * lives on its own cache line so the two threads don't fight over it. */
+typedef struct {
+    uchar *data;
+    size_t mask;
+
+    size_t head __attribute__((aligned(64)));
+    size_t tail __attribute__((aligned(64)));
+} JTermRing;
+
+void ring_init(JTermRing *ring, size_t size);
+void ring_free(JTermRing *ring);
+
+// Producer side: contiguous free span at head, then publish n bytes of it.
+size_t ring_write_span(JTermRing *ring, uchar **span);
+void ring_commit(JTermRing *ring, size_t n);
+
+// Consumer side: contiguous readable span at tail, then release n bytes.
+size_t ring_read_span(JTermRing *ring, uchar **span);
+void ring_consume(JTermRing *ring, size_t n);
+
+size_t ring_used(JTermRing *ring);
+
+#endif
@@ -0,0 +1,601 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "scrollback.h"
+
+#define NO_PAGE ULONG_MAX
+// the disk file is grown (sparsely) and remapped in steps of at least this
+#define DISK_MAP_MIN (64UL * 1024 * 1024)
+
+static void grow(uchar **buf, size_t *cap, size_t need) {
+    if (need <= *cap)
+        return;
+    *cap = MAX(*cap * 2, need);
+    *buf = realloc(*buf, *cap);
+    if (!*buf) {
+        ERROR("scrollback: out of memory");
+    }
+}
+
+//---Codec---
+/* PackBits-style run-length coding. A header byte h < 0x80 is followed by
+ * h + 1 literal bytes, h >= 0x80 by one byte repeated (h & 0x7F) + 3
+ * times. Cheap both ways and good at what scrollback is full of: runs of
+ * spaces, rules of '-' or '=', and repeated style runs. */
+#define RLE_MAX_LITERAL 128
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN (0x7F + RLE_MIN_RUN)
+#define RLE_BOUND(n) ((n) + (n) / RLE_MAX_LITERAL + 1)
+/* A page that doesn't get at least 1/RLE_MIN_GAIN smaller is stored as
+ * is, and the next RLE_SKIP_PAGES pages are too without trying. Output
+ * that doesn't compress, plain prose or code, then costs no time. */
+#define RLE_MIN_GAIN 16
+#define RLE_SKIP_PAGES 16
+
+static size_t rle_compress(const uchar *src, size_t n, uchar *dst) {
+    size_t i = 0, o = 0;
+
+    while (i < n) {
+        size_t run = 1;
+        while (i + run < n && run < RLE_MAX_RUN && src[i + run] == src[i])
+            run++;
+        if (run >= RLE_MIN_RUN) {
+            dst[o++] = 0x80 | (run - RLE_MIN_RUN);
+            dst[o++] = src[i];
+            i += run;
+            continue;
+        }
+
+        // literals up to the next run worth encoding
+        size_t start = i, len = 0;
+        while (i < n && len < RLE_MAX_LITERAL) {
+            if (i + 2 < n && src[i] == src[i + 1] && src[i] == src[i + 2])
+                break;
+            i++;
+            len++;
+        }
+        dst[o++] = len - 1;
+        memcpy(&dst[o], &src[start], len);
+        o += len;
+    }
+    return o;
+}
+
+static void rle_decompress(const uchar *src, size_t n, uchar *dst) {
+    size_t i = 0, o = 0;
+
+    while (i < n) {
+        uchar h = src[i++];
+        if (h & 0x80) {
+            size_t run = (h & 0x7F) + RLE_MIN_RUN;
+            memset(&dst[o], src[i++], run);
+            o += run;
+        } else {
+            size_t len = h + 1;
+            memcpy(&dst[o], &src[i], len);
+            i += len;
+            o += len;
+        }
+    }
+}
+
+//---Line packing---
+/* A packed page is
+ *   uint offset of the palette, SCROLLBACK_PAGE_LINES packed lines,
+ *   varint pens, (varint fg, varint bg, varint attrs)* at the offset,
+ * and a packed line is
+ *   varint len, byte flags, varint style runs, (varint pen, varint n)*,
+ *   len codepoints as UTF-8,
+ * with pen an index into the page's palette. */
+static uchar *put_varint(uchar *p, uint v) {
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const uchar *get_varint(const uchar *p, uint *v) {
+    uint shift = 0;
+    *v = 0;
+    do {
+        *v |= (uint)(*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    return p;
+}
+
+static uchar *put_utf8(uchar *p, uint cp) {
+    if (cp < 0x80) {
+        *p++ = cp;
+    } else if (cp < 0x800) {
+        *p++ = 0xC0 | cp >> 6;
+        *p++ = 0x80 | (cp & 0x3F);
+    } else if (cp < 0x10000) {
+        *p++ = 0xE0 | cp >> 12;
+        *p++ = 0x80 | (cp >> 6 & 0x3F);
+        *p++ = 0x80 | (cp & 0x3F);
+    } else {
+        *p++ = 0xF0 | cp >> 18;
+        *p++ = 0x80 | (cp >> 12 & 0x3F);
+        *p++ = 0x80 | (cp >> 6 & 0x3F);
+        *p++ = 0x80 | (cp & 0x3F);
+    }
+    return p;
+}
+
+static const uchar *get_utf8(const uchar *p, uint *cp) {
+    uchar c = *p++;
+    uint extra = c < 0x80 ? 0 : c < 0xE0 ? 1 : c < 0xF0 ? 2 : 3;
+
+    *cp = extra ? c & (0x3F >> extra) : c;
+    while (extra--)
+        *cp = *cp << 6 | (*p++ & 0x3F);
+    return p;
+}
+
+// Upper bound on the packed size of a line of len cells.
+#define PACKED_BOUND(len) (5 + 1 + 5 + (len) * (3 + 5) + (len) * 4)
+// and of a pen in the palette
+#define PEN_BOUND (3 * 5)
+
+// Index of style in the palette of the page being packed, added if new.
+static uint palette_index(JTermScrollback *sb, JTermStyle style) {
+    if (!sb->palette_index[style]) {
+        sb->palette[sb->npalette++] = style;
+        sb->palette_index[style] = sb->npalette;
+    }
+    return sb->palette_index[style] - 1;
+}
+
+static uchar *pack_line(JTermScrollback *sb, uchar *p, const JTermLine *l) {
+    p = put_varint(p, l->len);
+    *p++ = l->flags;
+
+    // the runs go after room for their count, which moves down after
+    uchar *count = p, *runs_start = p + 5;
+    uint runs = 0;
+    p = runs_start;
+    for (uint x = 0; x < l->len; runs++) {
+        uint n = 1;
+#ifdef __SSE2__
+        // runs are long, usually the whole line, 8 styles per step
+        __m128i same = _mm_set1_epi16(l->style[x]);
+        while (x + n + 8 <= l->len &&
+               _mm_movemask_epi8(_mm_cmpeq_epi16(
+                   _mm_loadu_si128((const __m128i *)&l->style[x + n]),
+                   same)) == 0xFFFF)
+            n += 8;
+#endif
+        while (x + n < l->len && l->style[x + n] == l->style[x])
+            n++;
+        p = put_varint(p, palette_index(sb, l->style[x]));
+        p = put_varint(p, n);
+        x += n;
+    }
+    uchar *runs_end = put_varint(count, runs);
+    memmove(runs_end, runs_start, p - runs_start);
+    p = runs_end + (p - runs_start);
+
+    uint x = 0;
+#ifdef __SSE2__
+    /* 16 codepoints narrowed to bytes per step while they are ASCII. Both
+     * packs saturate, so anything above 0x7F ends up with the top bit set
+     * and stops it. */
+    for (; x + 16 <= l->len; x += 16) {
+        const __m128i *t = (const __m128i *)&l->text[x];
+        __m128i lo = _mm_packs_epi32(_mm_loadu_si128(t),
+                                     _mm_loadu_si128(t + 1));
+        __m128i hi = _mm_packs_epi32(_mm_loadu_si128(t + 2),
+                                     _mm_loadu_si128(t + 3));
+        __m128i bytes = _mm_packus_epi16(lo, hi);
+        if (_mm_movemask_epi8(bytes))
+            break;
+        _mm_storeu_si128((__m128i *)p, bytes);
+        p += 16;
+    }
+#endif
+    for (; x < l->len; x++) {
+        if (l->text[x] < 0x80)
+            *p++ = l->text[x];
+        else
+            p = put_utf8(p, l->text[x]);
+    }
+    return p;
+}
+
+static void reserve_line(JTermLine *l, uint len) {
+    if (l->cap >= len)
+        return;
+    l->text = realloc(l->text, sizeof(uint) * len);
+    l->style = realloc(l->style, sizeof(JTermStyle) * len);
+    if (!l->text || !l->style) {
+        ERROR("scrollback: out of memory");
+    }
+    l->cap = len;
+}
+
+static const uchar *unpack_line(JTermScrollback *sb, const uchar *p,
+                                JTermLine *l) {
+    uint len, runs;
+
+    p = get_varint(p, &len);
+    reserve_line(l, len);
+    l->len = len;
+    l->flags = *p++;
+
+    p = get_varint(p, &runs);
+    for (uint x = 0; runs--;) {
+        uint pen, n;
+        p = get_varint(p, &pen);
+        p = get_varint(p, &n);
+        JTermStyle style = sb->cache_styles[pen];
+        while (n--)
+            l->style[x++] = style;
+    }
+
+    for (uint x = 0; x < len; x++)
+        p = get_utf8(p, &l->text[x]);
+    return p;
+}
+
+//---Pages---
+static JTermLine *hot_line(JTermScrollback *sb, uint i) {
+    return &sb->hot[(sb->hot_start + i) % SCROLLBACK_HOT_LINES];
+}
+
+static bool disk_reserve(JTermScrollback *sb, size_t size) {
+    if (size <= sb->disk.map_size)
+        return true;
+
+    size_t map_size = MAX(sb->disk.map_size * 2, MAX(size, DISK_MAP_MIN));
+    // the file is sparse, only what was written takes space
+    if (ftruncate(sb->disk.fd, map_size) == -1) {
+        perror("ftruncate(scrollback)");
+        return false;
+    }
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, sb->disk.fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap(scrollback)");
+        return false;
+    }
+    if (sb->disk.map)
+        munmap(sb->disk.map, sb->disk.map_size);
+    sb->disk.map = map;
+    sb->disk.map_size = map_size;
+    return true;
+}
+
+static bool disk_append(JTermScrollback *sb, const JTermPage *page) {
+    if (!disk_reserve(sb, sb->disk.size + page->size))
+        return false;
+    if (pwrite(sb->disk.fd, page->data, page->size, sb->disk.size) !=
+        (ssize_t)page->size) {
+        perror("pwrite(scrollback)");
+        return false;
+    }
+
+    if (sb->disk.count == sb->disk.cap) {
+        sb->disk.cap = MAX(sb->disk.cap * 2, 64);
+        sb->disk.index =
+            realloc(sb->disk.index, sizeof(JTermDiskPage) * sb->disk.cap);
+        if (!sb->disk.index) {
+            ERROR("scrollback: out of memory");
+        }
+    }
+    sb->disk.index[sb->disk.count++] = (JTermDiskPage){
+        .offset = sb->disk.size,
+        .size = page->size,
+        .raw_size = page->raw_size,
+    };
+    sb->disk.size += page->size;
+    return true;
+}
+
+static void free_page(JTermScrollback *sb) {
+    JTermPage *page = &sb->pages[sb->first];
+
+    sb->cold_bytes -= page->size;
+    sb->raw_bytes -= page->raw_size;
+    free(page->data);
+    sb->first++;
+    sb->count--;
+}
+
+static void evict_oldest_page(JTermScrollback *sb) {
+    if (sb->disk.fd != -1 && disk_append(sb, &sb->pages[sb->first])) {
+        free_page(sb);
+        return;
+    }
+    // without a disk, or once it fails, history before this is lost
+    sb->dropped += (ulong)(sb->disk.count + 1) * SCROLLBACK_PAGE_LINES;
+    sb->disk.count = 0;
+    sb->disk.size = 0;
+    free_page(sb);
+}
+
+static void enforce_budget(JTermScrollback *sb) {
+    while (sb->count && sb->hot_bytes + sb->cold_bytes > sb->budget)
+        evict_oldest_page(sb);
+}
+
+static JTermPage *new_page(JTermScrollback *sb) {
+    if (sb->first + sb->count == sb->cap) {
+        if (sb->first > sb->cap / 2) {
+            memmove(sb->pages, &sb->pages[sb->first],
+                    sizeof(JTermPage) * sb->count);
+        } else {
+            sb->cap = MAX(sb->cap * 2, 16);
+            sb->pages = realloc(sb->pages, sizeof(JTermPage) * sb->cap);
+            if (!sb->pages) {
+                ERROR("scrollback: out of memory");
+            }
+            memmove(sb->pages, &sb->pages[sb->first],
+                    sizeof(JTermPage) * sb->count);
+        }
+        sb->first = 0;
+    }
+    return &sb->pages[sb->first + sb->count++];
+}
+
+// Move the oldest SCROLLBACK_PAGE_LINES hot lines into a new page.
+static void pack_page(JTermScrollback *sb) {
+    size_t bound = sizeof(uint);
+    for (uint i = 0; i < SCROLLBACK_PAGE_LINES; i++)
+        bound += PACKED_BOUND(hot_line(sb, i)->len);
+    grow(&sb->pack, &sb->pack_cap, bound);
+    if (!sb->palette) {
+        sb->palette = malloc(sizeof(JTermStyle) * STYLE_MAX);
+        sb->palette_index = calloc(STYLE_MAX, sizeof(uint));
+        if (!sb->palette || !sb->palette_index) {
+            ERROR("scrollback: out of memory");
+        }
+    }
+
+    uchar *p = sb->pack + sizeof(uint);
+    for (uint i = 0; i < SCROLLBACK_PAGE_LINES; i++)
+        p = pack_line(sb, p, hot_line(sb, i));
+
+    // the palette goes after the lines, its offset in front of them
+    uint offset = p - sb->pack;
+    memcpy(sb->pack, &offset, sizeof(offset));
+    grow(&sb->pack, &sb->pack_cap, offset + 5 + sb->npalette * PEN_BOUND);
+    p = put_varint(sb->pack + offset, sb->npalette);
+    for (uint i = 0; i < sb->npalette; i++) {
+        const JTermPen *pen = styles_pen(sb->styles, sb->palette[i]);
+        p = put_varint(p, pen->fg);
+        p = put_varint(p, pen->bg);
+        p = put_varint(p, pen->attrs);
+        sb->palette_index[sb->palette[i]] = 0;
+    }
+    sb->npalette = 0;
+
+    JTermPage *page = new_page(sb);
+    page->raw_size = p - sb->pack;
+    page->size = page->raw_size;
+    if (sb->rle_skip) {
+        sb->rle_skip--;
+    } else {
+        grow(&sb->rle, &sb->rle_cap, RLE_BOUND(page->raw_size));
+        size_t size = rle_compress(sb->pack, page->raw_size, sb->rle);
+        if (size <= page->raw_size - page->raw_size / RLE_MIN_GAIN)
+            page->size = size;
+        else
+            sb->rle_skip = RLE_SKIP_PAGES;
+    }
+    // size == raw_size marks the page as stored as is
+    page->data = malloc(page->size);
+    if (!page->data) {
+        ERROR("scrollback: out of memory");
+    }
+    memcpy(page->data, page->size == page->raw_size ? sb->pack : sb->rle,
+           page->size);
+
+    sb->cold_bytes += page->size;
+    sb->raw_bytes += page->raw_size;
+    sb->hot_start = (sb->hot_start + SCROLLBACK_PAGE_LINES) %
+                    SCROLLBACK_HOT_LINES;
+    sb->hot_count -= SCROLLBACK_PAGE_LINES;
+}
+
+// abs counts pages ever packed: dropped ones, then disk, then memory
+static void unpack_page(JTermScrollback *sb, ulong abs) {
+    const uchar *data;
+    uint size, raw_size;
+
+    if (sb->cache_page == abs)
+        return;
+
+    ulong i = abs - sb->dropped / SCROLLBACK_PAGE_LINES;
+    if (i < sb->disk.count) {
+        JTermDiskPage *page = &sb->disk.index[i];
+        data = &sb->disk.map[page->offset];
+        size = page->size;
+        raw_size = page->raw_size;
+    } else {
+        JTermPage *page = &sb->pages[sb->first + i - sb->disk.count];
+        data = page->data;
+        size = page->size;
+        raw_size = page->raw_size;
+    }
+
+    grow(&sb->cache, &sb->cache_cap, raw_size);
+    if (size == raw_size)
+        memcpy(sb->cache, data, size);
+    else
+        rle_decompress(data, size, sb->cache);
+
+    uint offset, pens;
+    memcpy(&offset, sb->cache, sizeof(offset));
+    const uchar *p = get_varint(&sb->cache[offset], &pens);
+    if (pens > sb->cache_styles_cap) {
+        sb->cache_styles_cap = MAX(sb->cache_styles_cap * 2, pens);
+        sb->cache_styles = realloc(sb->cache_styles,
+                                   sizeof(JTermStyle) * sb->cache_styles_cap);
+        if (!sb->cache_styles) {
+            ERROR("scrollback: out of memory");
+        }
+    }
+    sb->cache_nstyles = 0;
+    for (uint i = 0; i < pens; i++) {
+        JTermPen pen;
+        p = get_varint(p, &pen.fg);
+        p = get_varint(p, &pen.bg);
+        p = get_varint(p, &pen.attrs);
+        // may collect the table, which renumbers the ones so far too
+        JTermStyle style = styles_intern(sb->styles, &pen);
+        sb->cache_styles[sb->cache_nstyles++] = style;
+    }
+
+    p = sb->cache + sizeof(uint);
+    for (uint i = 0; i < SCROLLBACK_PAGE_LINES; i++) {
+        sb->cache_offsets[i] = p - sb->cache;
+        p = unpack_line(sb, p, &sb->out);
+    }
+    sb->cache_page = abs;
+}
+
+//---Public---
+void scrollback_init(JTermScrollback *sb, size_t budget,
+                     JTermStyles *styles) {
+    memset(sb, 0, sizeof(*sb));
+    sb->budget = budget;
+    sb->styles = styles;
+    sb->cache_page = NO_PAGE;
+    sb->disk.fd = -1;
+}
+
+void scrollback_free(JTermScrollback *sb) {
+    for (uint i = 0; i < SCROLLBACK_HOT_LINES; i++) {
+        free(sb->hot[i].text);
+        free(sb->hot[i].style);
+    }
+    while (sb->count)
+        free_page(sb);
+    free(sb->pages);
+    if (sb->disk.map)
+        munmap(sb->disk.map, sb->disk.map_size);
+    if (sb->disk.fd != -1)
+        close(sb->disk.fd);
+    free(sb->disk.index);
+    free(sb->cache);
+    free(sb->cache_styles);
+    free(sb->out.text);
+    free(sb->out.style);
+    free(sb->pack);
+    free(sb->rle);
+    free(sb->palette);
+    free(sb->palette_index);
+    memset(sb, 0, sizeof(*sb));
+}
+
+void scrollback_set_budget(JTermScrollback *sb, size_t budget) {
+    sb->budget = budget;
+    enforce_budget(sb);
+}
+
+bool scrollback_enable_disk(JTermScrollback *sb, const char *dir) {
+    char path[4096];
+
+    if (sb->disk.fd != -1)
+        return true;
+
+    snprintf(path, sizeof(path), "%s/jterm-scrollback-XXXXXX", dir);
+    sb->disk.fd = mkstemp(path);
+    if (sb->disk.fd == -1) {
+        perror("mkstemp(scrollback)");
+        return false;
+    }
+    // nobody else needs the name, and it goes away with us
+    unlink(path);
+    return true;
+}
+
+void scrollback_push(JTermScrollback *sb, const uint *text,
+                     const JTermStyle *style, uint len, uchar flags) {
+    // trailing default blanks are implied
+#ifdef __SSE2__
+    // usually most of the row, 8 cells per step
+    __m128i space = _mm_set1_epi32(' ');
+    __m128i blank = _mm_set1_epi16(STYLE_DEFAULT);
+    while (len >= 8) {
+        const __m128i *t = (const __m128i *)&text[len - 8];
+        __m128i s = _mm_loadu_si128((const __m128i *)&style[len - 8]);
+        __m128i spaces = _mm_and_si128(
+            _mm_cmpeq_epi32(_mm_loadu_si128(t), space),
+            _mm_cmpeq_epi32(_mm_loadu_si128(t + 1), space));
+        if (_mm_movemask_epi8(_mm_and_si128(
+                spaces, _mm_cmpeq_epi16(s, blank))) != 0xFFFF)
+            break;
+        len -= 8;
+    }
+#endif
+    while (len && text[len - 1] == ' ' && style[len - 1] == STYLE_DEFAULT)
+        len--;
+
+    if (sb->hot_count == SCROLLBACK_HOT_LINES)
+        pack_page(sb);
+
+    JTermLine *l = hot_line(sb, sb->hot_count++);
+    if (l->cap < len) {
+        sb->hot_bytes += (len - l->cap) * (sizeof(uint) + sizeof(JTermStyle));
+        reserve_line(l, len);
+    }
+    if (len) {
+        memcpy(l->text, text, sizeof(uint) * len);
+        memcpy(l->style, style, sizeof(JTermStyle) * len);
+    }
+    l->len = len;
+    l->flags = flags & ROW_WRAPPED;
+
+    enforce_budget(sb);
+}
+
+ulong scrollback_lines(const JTermScrollback *sb) {
+    return sb->hot_count +
+           (ulong)(sb->count + sb->disk.count) * SCROLLBACK_PAGE_LINES;
+}
+
+const JTermLine *scrollback_line(JTermScrollback *sb, ulong n) {
+    if (n < sb->hot_count)
+        return hot_line(sb, sb->hot_count - 1 - n);
+
+    n -= sb->hot_count;
+    ulong newest = sb->dropped / SCROLLBACK_PAGE_LINES + sb->disk.count +
+                   sb->count - 1;
+    unpack_page(sb, newest - n / SCROLLBACK_PAGE_LINES);
+
+    uint i = SCROLLBACK_PAGE_LINES - 1 - n % SCROLLBACK_PAGE_LINES;
+    unpack_line(sb, &sb->cache[sb->cache_offsets[i]], &sb->out);
+    return &sb->out;
+}
+
+void scrollback_visit_styles(JTermScrollback *sb, JTermStylesVisit visit) {
+    for (uint i = 0; i < sb->hot_count; i++) {
+        JTermLine *l = hot_line(sb, i);
+        visit(sb->styles, l->style, l->len);
+    }
+    // what was last handed out, and the page it came from
+    visit(sb->styles, sb->out.style, sb->out.len);
+    visit(sb->styles, sb->cache_styles, sb->cache_nstyles);
+}
+
+void scrollback_stats(const JTermScrollback *sb, JTermScrollbackStats *stats) {
+    stats->lines = scrollback_lines(sb);
+    stats->hot_lines = sb->hot_count;
+    stats->pages = sb->count;
+    stats->hot_bytes = sb->hot_bytes;
+    stats->cold_bytes = sb->cold_bytes;
+    stats->raw_bytes = sb->raw_bytes;
+    stats->dropped_lines = sb->dropped;
+    stats->disk_pages = sb->disk.count;
+    stats->disk_bytes = sb->disk.size;
+}
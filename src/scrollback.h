@@ -0,0 +1,131 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stddef.h>
+
+#include "common.h"
+#include "grid.h"
+
+/* Lines that scrolled off the top of the screen.
+ *
+ * The newest SCROLLBACK_HOT_LINES are kept as plain rows. Older lines are
+ * packed SCROLLBACK_PAGE_LINES at a time into pages: trailing blanks are
+ * dropped, styles become (pen, run length) pairs over a palette of the
+ * page's pens, text becomes UTF-8, and the result is run-length
+ * compressed. Pages keep pens rather than styles so they don't pin
+ * anything in the style table; unpacking interns them again. Once
+ * everything together exceeds the memory budget the oldest pages are
+ * dropped. Pages are unpacked again only when someone scrolls back that
+ * far.
+ *
+ * With scrollback_enable_disk() evicted pages aren't dropped but appended
+ * to an unlinked, sparse file that is mmap()ed for reading, so history is
+ * bounded by disk rather than by the budget. Every page holds exactly
+ * SCROLLBACK_PAGE_LINES lines, so finding line n on disk is arithmetic on
+ * the page index. */
+
+#define SCROLLBACK_HOT_LINES 1024
+#define SCROLLBACK_PAGE_LINES 256
+#define SCROLLBACK_BUDGET (32 * 1024 * 1024)
+
+typedef struct {
+    uint *text;
+    JTermStyle *style;
+    uint len, cap;
+    uchar flags;
+} JTermLine;
+
+typedef struct {
+    uchar *data;
+    uint size;     // compressed
+    uint raw_size; // packed, before compression
+} JTermPage;
+
+typedef struct {
+    ulong offset;
+    uint size, raw_size;
+} JTermDiskPage;
+
+typedef struct {
+    ulong lines;
+    ulong hot_lines;
+    ulong pages;
+    ulong hot_bytes;
+    ulong cold_bytes;
+    // cold bytes before compression, for the compression ratio
+    ulong raw_bytes;
+    ulong dropped_lines;
+    ulong disk_pages;
+    ulong disk_bytes;
+} JTermScrollbackStats;
+
+typedef struct {
+    size_t budget;
+    JTermStyles *styles;
+
+    // circular, oldest at hot_start
+    JTermLine hot[SCROLLBACK_HOT_LINES];
+    uint hot_start, hot_count;
+    size_t hot_bytes;
+
+    // oldest first, pages[first] is the oldest still kept
+    JTermPage *pages;
+    uint first, count, cap;
+    size_t cold_bytes, raw_bytes;
+    // lines gone for good, always a multiple of SCROLLBACK_PAGE_LINES
+    ulong dropped;
+
+    // evicted pages, older than pages[first], when fd != -1
+    struct {
+        int fd;
+        uchar *map;
+        size_t map_size, size;
+        JTermDiskPage *index;
+        uint count, cap;
+    } disk;
+
+    // the most recently unpacked page, and where its lines start
+    ulong cache_page;
+    uchar *cache;
+    size_t cache_cap;
+    uint cache_offsets[SCROLLBACK_PAGE_LINES];
+    // its palette interned, palette index to style
+    JTermStyle *cache_styles;
+    uint cache_nstyles, cache_styles_cap;
+    JTermLine out;
+
+    // scratch for packing and compressing
+    uchar *pack, *rle;
+    size_t pack_cap, rle_cap;
+    // the palette of the page being packed, and per style its index + 1
+    JTermStyle *palette;
+    uint npalette;
+    uint *palette_index;
+    // pages left to store without trying to compress them
+    uint rle_skip;
+} JTermScrollback;
+
+// Styles of pushed rows are from styles, and so are the ones handed out.
+void scrollback_init(JTermScrollback *sb, size_t budget,
+                     JTermStyles *styles);
+void scrollback_free(JTermScrollback *sb);
+void scrollback_set_budget(JTermScrollback *sb, size_t budget);
+// Spill evicted pages to a temporary file in dir instead of dropping them.
+bool scrollback_enable_disk(JTermScrollback *sb, const char *dir);
+
+// Append a row that is leaving the top of the screen.
+void scrollback_push(JTermScrollback *sb, const uint *text,
+                     const JTermStyle *style, uint len, uchar flags);
+
+ulong scrollback_lines(const JTermScrollback *sb);
+/* Line n counting back from the newest (0). The result stays valid until
+ * the next call into the scrollback. */
+const JTermLine *scrollback_line(JTermScrollback *sb, ulong n);
+
+/* Hand every style the scrollback holds as an index to visit, for
+ * collecting the style table. */
+void scrollback_visit_styles(JTermScrollback *sb, JTermStylesVisit visit);
+
+void scrollback_stats(const JTermScrollback *sb, JTermScrollbackStats *stats);
+
+#endif
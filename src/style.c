@@ -0,0 +1,200 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "style.h"
+
+#define INITIAL_CAP 64
+
+// the sokol_color colours the 16 colours have always been drawn with
+static const uint ansi[16] = {
+    0x000000, 0xFF0000, 0x00FF00, 0xFFFF00,
+    0x0000FF, 0xFF00FF, 0x00FFFF, DEFAULT_FG_RGB,
+    0xBEBEBE, 0xDB7093, 0x90EE90, 0xFFFFE0,
+    0xADD8E6, 0xFFC0CB, 0xE0FFFF, 0xFFFFFF,
+};
+
+static uint palette_rgb(uint i) {
+    if (i < 16)
+        return ansi[i];
+    if (i < 232) {
+        // xterm's cube: 0, then 95 to 255 in steps of 40
+        static const uchar level[6] = {0, 95, 135, 175, 215, 255};
+        i -= 16;
+        return level[i / 36] << 16 | level[i / 6 % 6] << 8 | level[i % 6];
+    }
+    uint grey = 8 + (i - 232) * 10;
+    return grey << 16 | grey << 8 | grey;
+}
+
+static uint color_rgb(uint color, uint def) {
+    if (color & COLOR_RGB)
+        return color & 0xFFFFFF;
+    return color == COLOR_DEFAULT ? def : palette_rgb(color);
+}
+
+static void put_rgb(uchar out[3], uint rgb) {
+    out[0] = rgb >> 16;
+    out[1] = rgb >> 8;
+    out[2] = rgb;
+}
+
+static JTermLook resolve(const JTermPen *pen) {
+    uint fg = color_rgb(pen->fg, DEFAULT_FG_RGB);
+    uint bg = color_rgb(pen->bg, DEFAULT_BG_RGB);
+    JTermLook look = {.attrs = pen->attrs};
+
+    if (pen->attrs & ATTR_DIM) {
+        // halfway to the background, per channel
+        uint mixed = 0;
+        for (uint shift = 0; shift < 24; shift += 8)
+            mixed |= ((fg >> shift & 0xFF) + (bg >> shift & 0xFF)) / 2 << shift;
+        fg = mixed;
+    }
+    if (pen->attrs & ATTR_INVERSE) {
+        uint swap = fg;
+        fg = bg;
+        bg = swap;
+    }
+    if (pen->attrs & ATTR_HIDDEN)
+        fg = bg;
+    put_rgb(look.fg, fg);
+    put_rgb(look.bg, bg);
+    return look;
+}
+
+static uint hash(const JTermPen *pen) {
+    uint h = pen->fg * 0x9E3779B1u;
+    h = (h ^ pen->bg) * 0x85EBCA77u;
+    h = (h ^ pen->attrs) * 0xC2B2AE3Du;
+    return h ^ h >> 15;
+}
+
+static bool same(const JTermPen *a, const JTermPen *b) {
+    return a->fg == b->fg && a->bg == b->bg && a->attrs == b->attrs;
+}
+
+static void *alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        ERROR("style: out of memory");
+    }
+    return p;
+}
+
+// Slots at most half full, rebuilt from the pens.
+static void rehash(JTermStyles *s, uint slots) {
+    free(s->slots);
+    s->slots = calloc(slots, sizeof(*s->slots));
+    if (!s->slots) {
+        ERROR("style: out of memory");
+    }
+    s->mask = slots - 1;
+    for (uint i = 0; i < s->count; i++) {
+        uint slot = hash(&s->pens[i]) & s->mask;
+        while (s->slots[slot])
+            slot = (slot + 1) & s->mask;
+        s->slots[slot] = i + 1;
+    }
+}
+
+void styles_init(JTermStyles *s) {
+    memset(s, 0, sizeof(*s));
+    s->cap = INITIAL_CAP;
+    s->pens = alloc(NULL, sizeof(*s->pens) * s->cap);
+    s->looks = alloc(NULL, sizeof(*s->looks) * s->cap);
+    rehash(s, INITIAL_CAP * 2);
+    styles_intern(s, &(JTermPen){COLOR_DEFAULT, COLOR_DEFAULT, 0});
+}
+
+void styles_free(JTermStyles *s) {
+    free(s->pens);
+    free(s->looks);
+    free(s->slots);
+    free(s->used);
+    free(s->remap);
+    memset(s, 0, sizeof(*s));
+}
+
+// The slot holding pen, or the empty one it would go in.
+static uint find(const JTermStyles *s, const JTermPen *pen) {
+    uint slot = hash(pen) & s->mask;
+    for (; s->slots[slot]; slot = (slot + 1) & s->mask) {
+        if (same(&s->pens[s->slots[slot] - 1], pen))
+            break;
+    }
+    return slot;
+}
+
+static void collect(JTermStyles *s) {
+    if (!s->used) {
+        s->used = calloc(STYLE_MAX, 1);
+        s->remap = alloc(NULL, sizeof(*s->remap) * STYLE_MAX);
+        if (!s->used) {
+            ERROR("style: out of memory");
+        }
+    }
+    s->collect(s->collect_user);
+    s->collections++;
+}
+
+JTermStyle styles_intern(JTermStyles *s, const JTermPen *pen) {
+    uint slot = find(s, pen);
+    if (s->slots[slot])
+        return s->slots[slot] - 1;
+
+    if (s->count == STYLE_MAX && s->collect) {
+        collect(s);
+        slot = find(s, pen);
+    }
+    if (s->count == STYLE_MAX) {
+        if (!s->full)
+            WARN("style: %u styles in use, new ones are drawn plain",
+                 STYLE_MAX);
+        s->full = true;
+        return STYLE_DEFAULT;
+    }
+    if (s->count == s->cap) {
+        s->cap *= 2;
+        s->pens = alloc(s->pens, sizeof(*s->pens) * s->cap);
+        s->looks = alloc(s->looks, sizeof(*s->looks) * s->cap);
+    }
+
+    uint style = s->count++;
+    s->pens[style] = *pen;
+    s->looks[style] = resolve(pen);
+    if (s->count * 2 > s->mask + 1) {
+        rehash(s, (s->mask + 1) * 2);
+    } else {
+        s->slots[slot] = style + 1;
+    }
+    return style;
+}
+
+//---Collecting---
+void styles_mark(JTermStyles *s, JTermStyle *style, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        s->used[style[i]] = 1;
+}
+
+void styles_compact(JTermStyles *s) {
+    uint count = 0;
+
+    s->used[STYLE_DEFAULT] = 1;
+    // in order, so STYLE_DEFAULT stays put
+    for (uint i = 0; i < s->count; i++) {
+        if (!s->used[i])
+            continue;
+        s->remap[i] = count;
+        s->pens[count] = s->pens[i];
+        s->looks[count] = s->looks[i];
+        count++;
+    }
+    memset(s->used, 0, STYLE_MAX);
+    s->count = count;
+    rehash(s, s->mask + 1);
+}
+
+void styles_remap(JTermStyles *s, JTermStyle *style, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        style[i] = s->remap[style[i]];
+}
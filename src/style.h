@@ -0,0 +1,100 @@
+#ifndef STYLE_H
+#define STYLE_H
+
+#include "common.h"
+
+/* Colours as SGR sets them: a palette index (0-7 normal, 8-15 bright,
+ * 16-231 the 6x6x6 cube, 232-255 greys), COLOR_DEFAULT, or COLOR_RGB
+ * with a 24-bit 0xRRGGBB. */
+#define COLOR_DEFAULT 256
+#define COLOR_RGB (1u << 24)
+
+#define ATTR_BOLD (1 << 0)
+#define ATTR_UNDERLINE (1 << 1)
+#define ATTR_INVERSE (1 << 2)
+#define ATTR_DIM (1 << 3)
+#define ATTR_ITALIC (1 << 4)
+#define ATTR_HIDDEN (1 << 5)
+#define ATTR_STRIKE (1 << 6)
+
+// the renderer's default colours, 0xRRGGBB
+#define DEFAULT_FG_RGB 0xE6E6E6
+#define DEFAULT_BG_RGB 0x181818
+
+// Everything SGR controls.
+typedef struct {
+    uint fg, bg;
+    uint attrs;
+} JTermPen;
+
+/* A pen as the renderer draws it: colours resolved to RGB with dim,
+ * inverse and hidden already applied. Bold, italic, underline and strike
+ * are left to the shader. */
+typedef struct {
+    uchar fg[3], bg[3];
+    uchar attrs;
+} JTermLook;
+
+/* What a cell stores, an index into the terminal's style table. When the
+ * table fills up it is collected: styles nothing holds any more are
+ * dropped and the rest renumbered, so only the arrays the owner hands to
+ * the collection may keep indices. Packed scrollback keeps pens instead. */
+typedef ushort JTermStyle;
+
+#define STYLE_DEFAULT 0
+#define STYLE_MAX 65536
+
+/* Interned pens. SGR looks its pen up once per change and cells keep the
+ * 16-bit index; the renderer reads the resolved look by index. */
+typedef struct {
+    JTermPen *pens;
+    JTermLook *looks;
+    uint count, cap;
+
+    // open addressing on the pen, style + 1 per slot, 0 is empty
+    uint *slots;
+    uint mask;
+    bool full;
+
+    /* Called by styles_intern() when the table is full. It passes every
+     * array of styles still in use to styles_mark(), calls
+     * styles_compact(), then passes the same arrays to styles_remap(). */
+    void (*collect)(void *user);
+    void *collect_user;
+    // per style, marked in use, and where compacting moved it
+    uchar *used;
+    JTermStyle *remap;
+    // collections so far
+    ulong collections;
+} JTermStyles;
+
+// styles_mark() or styles_remap(), for whoever holds arrays of styles
+typedef void (*JTermStylesVisit)(JTermStyles *s, JTermStyle *style,
+                                 size_t n);
+
+void styles_init(JTermStyles *s);
+void styles_free(JTermStyles *s);
+/* The style for pen, added if it is new. A full table is collected
+ * first; only if every style is still in use do new pens get
+ * STYLE_DEFAULT. */
+JTermStyle styles_intern(JTermStyles *s, const JTermPen *pen);
+
+// Collecting: keep the n styles in style.
+void styles_mark(JTermStyles *s, JTermStyle *style, size_t n);
+/* Drop every style not marked, STYLE_DEFAULT excepted, and move the rest
+ * down in order. */
+void styles_compact(JTermStyles *s);
+// Renumber the n styles in style after styles_compact().
+void styles_remap(JTermStyles *s, JTermStyle *style, size_t n);
+
+static inline const JTermPen *styles_pen(const JTermStyles *s,
+                                         JTermStyle style) {
+    return &s->pens[style];
+}
+
+static inline const JTermLook *styles_look(const JTermStyles *s,
+                                           JTermStyle style) {
+    return &s->looks[style];
+}
+
+#endif
@@ -0,0 +1,641 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "probes.h"
+#include "term.h"
+
+#define TAB_WIDTH 8
+
+// Hand row y of g to the scrollback before it gets recycled.
+static void save_row(JTerm *t, JTermGrid *g, uint y) {
+    scrollback_push(&t->scrollback, grid_text(g, y), grid_style(g, y),
+                    *grid_end(g, y), *grid_flags(g, y));
+}
+
+/* Scroll the region up n lines. Only a region spanning the whole main
+ * screen feeds the scrollback; a full-screen scroll bumps the grid's top,
+ * anything smaller rotates the region's rows in the grid. Either way only
+ * the rows blanked at the bottom are drawn again. */
+static void scroll_up(JTerm *t, uint n) {
+    uint top = t->scroll_top, bottom = t->scroll_bottom;
+
+    PROBE2(scroll, top, bottom);
+    if (top == 0 && bottom == t->grid.h) {
+        for (n = MIN(n, bottom); n; n--) {
+            if (!t->alt_screen)
+                save_row(t, &t->grid, 0);
+            grid_scroll_up(&t->grid, t->erase);
+        }
+    } else {
+        grid_delete_rows(&t->grid, top, bottom, n, t->erase);
+    }
+}
+
+static void scroll_down(JTerm *t, uint n) {
+    PROBE2(scroll, t->scroll_top, t->scroll_bottom);
+    grid_insert_rows(&t->grid, t->scroll_top, t->scroll_bottom, n, t->erase);
+}
+
+static void linefeed(JTerm *t) {
+    if (t->y + 1 == t->scroll_bottom)
+        scroll_up(t, 1);
+    else if (t->y + 1 < t->grid.h)
+        t->y++;
+}
+
+static void reverse_index(JTerm *t) {
+    if (t->y == t->scroll_top)
+        scroll_down(t, 1);
+    else if (t->y > 0)
+        t->y--;
+}
+
+static bool in_region(const JTerm *t) {
+    return t->y >= t->scroll_top && t->y < t->scroll_bottom;
+}
+
+static void reset_region(JTerm *t) {
+    t->scroll_top = 0;
+    t->scroll_bottom = t->grid.h;
+}
+
+static void move_to(JTerm *t, int x, int y) {
+    t->x = CLAMP(x, 0, (int)t->grid.w - 1);
+    t->y = CLAMP(y, 0, (int)t->grid.h - 1);
+    t->wrap_pending = false;
+}
+
+// Deferred autowrap: the row we leave continues on the next one.
+static void wrap(JTerm *t) {
+    *grid_flags(&t->grid, t->y) |= ROW_WRAPPED;
+    t->x = 0;
+    linefeed(t);
+    t->wrap_pending = false;
+}
+
+static void set_pen(JTerm *t, const JTermPen *pen) {
+    // one lookup per change, cells just copy the index
+    t->pen = *pen;
+    t->style = styles_intern(&t->styles, pen);
+    t->erase = styles_intern(&t->styles,
+                             &(JTermPen){COLOR_DEFAULT, pen->bg, 0});
+}
+
+// DECSC and DECRC
+static void save_cursor(JTerm *t) {
+    t->saved_x = t->x;
+    t->saved_y = t->y;
+    t->saved_pen = t->pen;
+}
+
+static void restore_cursor(JTerm *t) {
+    set_pen(t, &t->saved_pen);
+    move_to(t, t->saved_x, t->saved_y);
+}
+
+//---Screens---
+/* Show the other screen. The grids trade places, which moves no cells, and
+ * only the row flags are touched so the renderer rebuilds every row. */
+static void swap_screens(JTerm *t) {
+    JTermGrid shown = t->grid;
+
+    t->grid = t->other;
+    t->other = shown;
+    t->alt_screen = !t->alt_screen;
+    t->alt_left = 0;
+    for (uint i = 0; i < t->grid.h; i++)
+        t->grid.row_flags[i] |= ROW_DIRTY;
+}
+
+static void use_alt_screen(JTerm *t, bool alt) {
+    if (alt == t->alt_screen)
+        return;
+    if (alt && !t->other.map)
+        grid_init(&t->other, t->grid.w, t->grid.h);
+    swap_screens(t);
+}
+
+//---Styles---
+static void visit_styles(JTerm *t, JTermStylesVisit visit) {
+    JTermGrid *grids[] = {&t->grid, &t->other};
+
+    for (uint i = 0; i < 2; i++) {
+        if (grids[i]->style)
+            visit(&t->styles, grids[i]->style,
+                  (size_t)grids[i]->w * grids[i]->h);
+    }
+    scrollback_visit_styles(&t->scrollback, visit);
+    visit(&t->styles, &t->style, 1);
+    visit(&t->styles, &t->erase, 1);
+}
+
+/* The style table is full: keep what the screens, the hot scrollback and
+ * the pen use, and renumber it. The looks don't change, so nothing needs
+ * to be drawn again. */
+static void collect_styles(void *user) {
+    JTerm *t = user;
+
+    visit_styles(t, styles_mark);
+    styles_compact(&t->styles);
+    visit_styles(t, styles_remap);
+}
+
+//---Parser callbacks---
+static void on_print(void *user, uint cp) {
+    JTerm *t = user;
+
+    if (t->wrap_pending)
+        wrap(t);
+
+    if (cp > GLYPH_MAX)
+        t->dropped_glyphs++;
+    grid_set(&t->grid, t->y, t->x, cp, t->style);
+    t->last = cp;
+    /* Stay on the last column until something else is printed, so a
+     * line that exactly fills the width isn't followed by a blank one. */
+    if (t->x + 1 < t->grid.w)
+        t->x++;
+    else
+        t->wrap_pending = true;
+}
+
+static void on_print_run(void *user, const uchar *run, size_t n) {
+    JTerm *t = user;
+
+    // same as on_print, but a whole row segment per step
+    while (n) {
+        if (t->wrap_pending)
+            wrap(t);
+
+        uint k = MIN(n, t->grid.w - t->x);
+        grid_write_ascii(&t->grid, t->y, t->x, run, k, t->style);
+        t->last = run[k - 1];
+        run += k;
+        n -= k;
+
+        if (t->x + k < t->grid.w) {
+            t->x += k;
+        } else {
+            t->x = t->grid.w - 1;
+            t->wrap_pending = true;
+        }
+    }
+}
+
+static void on_execute(void *user, uchar c) {
+    JTerm *t = user;
+
+    switch (c) {
+    case '\r':
+        t->x = 0;
+        t->wrap_pending = false;
+        break;
+    case '\n':
+    case '\v':
+    case '\f':
+        linefeed(t);
+        t->wrap_pending = false;
+        break;
+    case '\b':
+        if (t->x > 0)
+            t->x--;
+        t->wrap_pending = false;
+        break;
+    case '\t':
+        t->x = MIN((t->x / TAB_WIDTH + 1) * TAB_WIDTH, t->grid.w - 1);
+        break;
+    default: // BEL and friends
+        break;
+    }
+}
+
+/* The colour of "38;5;n" or "38;2;r;g;b" starting at params[*i], which is
+ * left on the last param used. Returns def for anything malformed. */
+static uint extended_color(JTermParser *p, uint *i, uint def) {
+    uint n = p->nparams - *i - 1;
+    int *v = &p->params[*i + 1];
+
+    if (n >= 2 && v[0] == 5) {
+        *i += 2;
+        return v[1] >= 0 && v[1] < 256 ? (uint)v[1] : def;
+    }
+    if (n >= 4 && v[0] == 2) {
+        *i += 4;
+        return COLOR_RGB | (CLAMP(v[1], 0, 255) << 16) |
+               (CLAMP(v[2], 0, 255) << 8) | CLAMP(v[3], 0, 255);
+    }
+    // nothing sensible follows, skip the rest
+    *i = p->nparams;
+    return def;
+}
+
+static void on_esc(void *user, JTermParser *p, uchar final) {
+    JTerm *t = user;
+
+    if (p->nintermediates)
+        return;
+
+    switch (final) {
+    case 'D': // IND
+        linefeed(t);
+        t->wrap_pending = false;
+        break;
+    case 'E': // NEL
+        linefeed(t);
+        t->x = 0;
+        t->wrap_pending = false;
+        break;
+    case 'M': // RI
+        reverse_index(t);
+        t->wrap_pending = false;
+        break;
+    case '7':
+        save_cursor(t);
+        break;
+    case '8':
+        restore_cursor(t);
+        break;
+    default:
+        break;
+    }
+}
+
+static void sgr(JTerm *t, JTermParser *p) {
+    JTermPen pen = t->pen;
+
+    // a bare "CSI m" is a reset, same as "CSI 0 m"
+    for (uint i = 0; i < MAX(p->nparams, 1); i++) {
+        int v = p->nparams ? p->params[i] : 0;
+        switch (v) {
+        case 0:
+            pen = (JTermPen){COLOR_DEFAULT, COLOR_DEFAULT, 0};
+            break;
+        case 1:
+            pen.attrs |= ATTR_BOLD;
+            break;
+        case 2:
+            pen.attrs |= ATTR_DIM;
+            break;
+        case 3:
+            pen.attrs |= ATTR_ITALIC;
+            break;
+        case 4:
+        case 21:
+            pen.attrs |= ATTR_UNDERLINE;
+            break;
+        case 7:
+            pen.attrs |= ATTR_INVERSE;
+            break;
+        case 8:
+            pen.attrs |= ATTR_HIDDEN;
+            break;
+        case 9:
+            pen.attrs |= ATTR_STRIKE;
+            break;
+        case 22:
+            pen.attrs &= ~(ATTR_BOLD | ATTR_DIM);
+            break;
+        case 23:
+            pen.attrs &= ~ATTR_ITALIC;
+            break;
+        case 24:
+            pen.attrs &= ~ATTR_UNDERLINE;
+            break;
+        case 27:
+            pen.attrs &= ~ATTR_INVERSE;
+            break;
+        case 28:
+            pen.attrs &= ~ATTR_HIDDEN;
+            break;
+        case 29:
+            pen.attrs &= ~ATTR_STRIKE;
+            break;
+        case 38:
+            pen.fg = extended_color(p, &i, pen.fg);
+            break;
+        case 39:
+            pen.fg = COLOR_DEFAULT;
+            break;
+        case 48:
+            pen.bg = extended_color(p, &i, pen.bg);
+            break;
+        case 49:
+            pen.bg = COLOR_DEFAULT;
+            break;
+        default:
+            if (v >= 30 && v <= 37)
+                pen.fg = v - 30;
+            else if (v >= 40 && v <= 47)
+                pen.bg = v - 40;
+            else if (v >= 90 && v <= 97)
+                pen.fg = v - 90 + 8;
+            else if (v >= 100 && v <= 107)
+                pen.bg = v - 100 + 8;
+            break;
+        }
+    }
+
+    set_pen(t, &pen);
+}
+
+// REP: cp n more times, a row span at a time like on_print_run().
+static void repeat(JTerm *t, uint cp, uint n) {
+    while (n) {
+        if (t->wrap_pending)
+            wrap(t);
+
+        uint k = MIN(n, t->grid.w - t->x);
+        grid_fill(&t->grid, t->y, t->x, t->x + k, cp, t->style);
+        if (cp > GLYPH_MAX)
+            t->dropped_glyphs += k;
+        n -= k;
+        if (t->x + k < t->grid.w) {
+            t->x += k;
+        } else {
+            t->x = t->grid.w - 1;
+            t->wrap_pending = true;
+        }
+    }
+}
+
+/* ED and EL; mode 0 is from the cursor on, 1 up to it, 2 everything. The
+ * row the cursor is on no longer runs on into the next one, and a pending
+ * wrap is dropped, as xterm does for both. */
+static void erase_line(JTerm *t, int mode) {
+    JTermGrid *g = &t->grid;
+
+    if (mode == 0)
+        grid_blank(g, t->y, t->x, g->w, t->erase);
+    else if (mode == 1)
+        grid_blank(g, t->y, 0, t->x + 1, t->erase);
+    else if (mode == 2)
+        grid_blank(g, t->y, 0, g->w, t->erase);
+    else
+        return;
+    *grid_flags(g, t->y) &= ~ROW_WRAPPED;
+    t->wrap_pending = false;
+}
+
+static void erase_display(JTerm *t, int mode) {
+    JTermGrid *g = &t->grid;
+    uint y0 = mode == 0 ? t->y + 1 : 0, y1 = mode == 1 ? t->y : g->h;
+
+    if (mode == 0 || mode == 1)
+        erase_line(t, mode);
+    else if (mode != 2)
+        return;
+    for (uint y = y0; y < y1; y++) {
+        grid_blank(g, y, 0, g->w, t->erase);
+        *grid_flags(g, y) &= ~ROW_WRAPPED;
+    }
+    t->wrap_pending = false;
+}
+
+static void set_private_mode(JTerm *t, int mode, bool on) {
+    switch (mode) {
+    case 47: // alternate screen
+        use_alt_screen(t, on);
+        break;
+    case 1047: // the same, cleared on the way out
+        if (!on && t->alt_screen)
+            erase_display(t, 2);
+        use_alt_screen(t, on);
+        break;
+    case 1048:
+        if (on)
+            save_cursor(t);
+        else
+            restore_cursor(t);
+        break;
+    case 1049: // 1048 and the alternate screen, cleared on the way in
+        if (on) {
+            save_cursor(t);
+            if (!t->alt_screen) {
+                use_alt_screen(t, true);
+                erase_display(t, 2);
+            }
+        } else {
+            use_alt_screen(t, false);
+            restore_cursor(t);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void reply(JTerm *t, const char *fmt, ...) {
+    char buf[64];
+    va_list ap;
+
+    if (!t->reply)
+        return;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    t->reply(t->reply_user, (const uchar *)buf, MIN(n, (int)sizeof(buf) - 1));
+}
+
+static void on_csi(void *user, JTermParser *p, uchar final) {
+    JTerm *t = user;
+    int x = t->x, y = t->y;
+
+    // DECSET and DECRST, the only private sequences so far
+    if (p->nintermediates == 1 && p->intermediates[0] == '?' &&
+        (final == 'h' || final == 'l')) {
+        for (uint i = 0; i < p->nparams; i++)
+            set_private_mode(t, p->params[i], final == 'h');
+        return;
+    }
+    if (p->nintermediates)
+        return;
+
+    switch (final) {
+    case 'm':
+        sgr(t, p);
+        break;
+    case 'A':
+        move_to(t, x, y - parser_param(p, 0, 1));
+        break;
+    case 'B':
+        move_to(t, x, y + parser_param(p, 0, 1));
+        break;
+    case 'C':
+        move_to(t, x + parser_param(p, 0, 1), y);
+        break;
+    case 'D':
+        move_to(t, x - parser_param(p, 0, 1), y);
+        break;
+    case 'E':
+        move_to(t, 0, y + parser_param(p, 0, 1));
+        break;
+    case 'F':
+        move_to(t, 0, y - parser_param(p, 0, 1));
+        break;
+    case 'G':
+        move_to(t, parser_param(p, 0, 1) - 1, y);
+        break;
+    case 'H':
+    case 'f':
+        move_to(t, parser_param(p, 1, 1) - 1, parser_param(p, 0, 1) - 1);
+        break;
+    case '`':
+        move_to(t, parser_param(p, 0, 1) - 1, y);
+        break;
+    case 'd':
+        move_to(t, x, parser_param(p, 0, 1) - 1);
+        break;
+    case 'J':
+        erase_display(t, parser_param(p, 0, 0));
+        break;
+    case 'K':
+        erase_line(t, parser_param(p, 0, 0));
+        break;
+    case 'X':
+        grid_blank(&t->grid, t->y, x,
+                   MIN(x + parser_param(p, 0, 1), (int)t->grid.w), t->erase);
+        break;
+    case '@':
+        grid_insert_cells(&t->grid, t->y, x, parser_param(p, 0, 1), t->erase);
+        t->wrap_pending = false;
+        break;
+    case 'P':
+        grid_delete_cells(&t->grid, t->y, x, parser_param(p, 0, 1), t->erase);
+        t->wrap_pending = false;
+        break;
+    case 'L':
+        if (!in_region(t))
+            break;
+        grid_insert_rows(&t->grid, t->y, t->scroll_bottom,
+                         parser_param(p, 0, 1), t->erase);
+        move_to(t, 0, y);
+        break;
+    case 'M':
+        if (!in_region(t))
+            break;
+        grid_delete_rows(&t->grid, t->y, t->scroll_bottom,
+                         parser_param(p, 0, 1), t->erase);
+        move_to(t, 0, y);
+        break;
+    case 'S':
+        scroll_up(t, parser_param(p, 0, 1));
+        break;
+    case 'T':
+        // without params only, with them it is mouse tracking
+        if (p->nparams <= 1)
+            scroll_down(t, parser_param(p, 0, 1));
+        break;
+    case 'r': {
+        // DECSTBM, a region has at least two lines
+        uint top = parser_param(p, 0, 1) - 1;
+        uint bottom = MIN(parser_param(p, 1, t->grid.h), (int)t->grid.h);
+        if (top + 1 < bottom) {
+            t->scroll_top = top;
+            t->scroll_bottom = bottom;
+            move_to(t, 0, 0);
+        }
+    } break;
+    case 'b':
+        // more than a screenful only scrolls the same row by again
+        repeat(t, t->last,
+               MIN(parser_param(p, 0, 1), (int)(t->grid.w * t->grid.h)));
+        break;
+    case 'c':
+        // primary DA: a VT102
+        if (!parser_param(p, 0, 0))
+            reply(t, "\x1b[?6c");
+        break;
+    case 'n':
+        // DSR: status, cursor position
+        if (parser_param(p, 0, 0) == 5)
+            reply(t, "\x1b[0n");
+        else if (parser_param(p, 0, 0) == 6)
+            reply(t, "\x1b[%d;%dR", y + 1, x + 1);
+        break;
+    default:
+        break;
+    }
+}
+
+static const JTermParserOps ops = {
+    .print = on_print,
+    .print_run = on_print_run,
+    .execute = on_execute,
+    .esc_dispatch = on_esc,
+    .csi_dispatch = on_csi,
+};
+
+//---Public---
+void term_init(JTerm *t, uint w, uint h) {
+    memset(t, 0, sizeof(*t));
+    parser_init(&t->parser, &ops, t);
+    grid_init(&t->grid, w, h);
+    reset_region(t);
+    scrollback_init(&t->scrollback, SCROLLBACK_BUDGET, &t->styles);
+    styles_init(&t->styles);
+    t->styles.collect = collect_styles;
+    t->styles.collect_user = t;
+    t->pen = t->saved_pen = *styles_pen(&t->styles, STYLE_DEFAULT);
+    t->style = t->erase = STYLE_DEFAULT;
+    t->last = ' ';
+}
+
+void term_free(JTerm *t) {
+    grid_free(&t->grid);
+    grid_free(&t->other);
+    scrollback_free(&t->scrollback);
+    styles_free(&t->styles);
+}
+
+/* Resize g keeping the rows around cursor row y, returns how many rows
+ * went off the top. The main screen's go to scrollback. */
+static uint resize_screen(JTerm *t, JTermGrid *g, uint y, uint w, uint h,
+                          bool main) {
+    uint top = y >= h ? y - h + 1 : 0;
+
+    for (uint i = 0; main && i < top; i++)
+        save_row(t, g, i);
+    grid_resize(g, w, h, top);
+    return top;
+}
+
+void term_resize(JTerm *t, uint w, uint h) {
+    PROBE2(resize, w, h);
+    if (t->alt_screen) {
+        // the main screen's cursor is the one saved on the way out
+        t->saved_y -= resize_screen(t, &t->other, t->saved_y, w, h, true);
+        move_to(t, t->x,
+                t->y - resize_screen(t, &t->grid, t->y, w, h, false));
+    } else {
+        // as if it had been freed for idling, it comes back blank
+        grid_free(&t->other);
+        move_to(t, t->x, t->y - resize_screen(t, &t->grid, t->y, w, h, true));
+    }
+    reset_region(t);
+}
+
+void term_feed(JTerm *t, const uchar *buf, size_t n) {
+    parser_feed(&t->parser, buf, n);
+}
+
+void term_clear(JTerm *t) {
+    for (uint y = 0; y < t->grid.h; y++) {
+        grid_blank(&t->grid, y, 0, t->grid.w, t->erase);
+        *grid_flags(&t->grid, y) &= ~ROW_WRAPPED;
+    }
+    move_to(t, 0, 0);
+}
+
+double term_tick(JTerm *t, double now) {
+    // only a left alternate screen is waiting for anything
+    if (t->alt_screen || !t->other.map)
+        return -1;
+    if (!t->alt_left)
+        t->alt_left = now;
+    double left = t->alt_left + ALT_SCREEN_KEEP - now;
+    if (left > 0)
+        return left;
+    grid_free(&t->other);
+    return -1;
+}
@@ -0,0 +1,74 @@
+#ifndef TERM_H
+#define TERM_H
+
+#include <stddef.h>
+
+#include "common.h"
+#include "grid.h"
+#include "parser.h"
+#include "scrollback.h"
+
+// seconds a left alternate screen is kept for a quick way back
+#define ALT_SCREEN_KEEP 30.0
+
+// the highest code the renderer's fonts have a glyph for
+#define GLYPH_MAX 0xFF
+
+// Sends bytes back to the application, answers to DSR, DA and the like.
+typedef void (*JTermReply)(void *user, const uchar *buf, size_t n);
+
+/* The emulated screen. Bytes from the PTY are parsed as they arrive and
+ * applied to cells, so the renderer only ever sees text and colours. */
+typedef struct {
+    JTermParser parser;
+
+    // the screen shown, main or alternate
+    JTermGrid grid;
+    /* The one not shown. Switching screens swaps the two, cells stay where
+     * they are. The alternate screen is allocated on first use; left
+     * unused for ALT_SCREEN_KEEP seconds it is freed again. */
+    JTermGrid other;
+    bool alt_screen;
+    // when term_tick() first saw the alternate screen left, 0 if not yet
+    double alt_left;
+    // rows that scrolled off the top of the main screen
+    JTermScrollback scrollback;
+
+    // cursor
+    uint x, y;
+    // the last column was written, wrap before the next print
+    bool wrap_pending;
+    // DECSC
+    uint saved_x, saved_y;
+    JTermPen saved_pen;
+    // DECSTBM margins, rows [scroll_top, scroll_bottom) scroll
+    uint scroll_top, scroll_bottom;
+    // what SGR set, and its style applied to printed and erased cells
+    JTermPen pen;
+    JTermStyle style;
+    // erased and scrolled in cells get the pen's background only
+    JTermStyle erase;
+    // the last character printed, for REP
+    uint last;
+    // characters above GLYPH_MAX printed, drawn as '?', since init
+    ulong dropped_glyphs;
+    // the styles of cells on screen and in scrollback, collected when full
+    JTermStyles styles;
+
+    // NULL drops the answers
+    JTermReply reply;
+    void *reply_user;
+} JTerm;
+
+void term_init(JTerm *t, uint w, uint h);
+void term_free(JTerm *t);
+void term_resize(JTerm *t, uint w, uint h);
+void term_feed(JTerm *t, const uchar *buf, size_t n);
+// Blank the screen and home the cursor.
+void term_clear(JTerm *t);
+/* Housekeeping that goes by time rather than output, freeing the
+ * alternate screen. Returns the seconds until it wants to be called
+ * again, or a negative number if there's nothing to wait for. */
+double term_tick(JTerm *t, double now);
+
+#endif
@@ -0,0 +1,50 @@
+#include <stdlib.h>
+
+#include "trace.h"
+
+void trace_init(JTermTrace *t, bool enabled) {
+    *t = (JTermTrace){.origin = now_seconds()};
+    if (!enabled)
+        return;
+    t->events = malloc(TRACE_EVENTS * sizeof(*t->events));
+    if (!t->events) {
+        ERROR("out of memory");
+    }
+}
+
+void trace_free(JTermTrace *t) {
+    free(t->events);
+    t->events = NULL;
+}
+
+bool trace_dump(const JTermTrace *t, const char *path, double seconds) {
+    if (!t->events)
+        return false;
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    ulong first = t->next > TRACE_EVENTS ? t->next - TRACE_EVENTS : 0;
+    double since = seconds ? now_seconds() - seconds : 0;
+    const char *sep = "";
+
+    /* Complete ("X") events nest by their times, so a phase inside another
+     * shows up below it without begin/end pairs. */
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (ulong i = first; i < t->next; i++) {
+        const JTermTraceEvent *e = &t->events[i % TRACE_EVENTS];
+        if (e->start + e->duration < since)
+            continue;
+        fprintf(f,
+                "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                "\"ts\":%.3f,\"dur\":%.3f",
+                sep, e->name, (e->start - t->origin) * 1e6, e->duration * 1e6);
+        if (e->bytes)
+            fprintf(f, ",\"args\":{\"bytes\":%lu}", e->bytes);
+        fputc('}', f);
+        sep = ",\n";
+    }
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) != EOF;
+}
@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Timings of the phases of each frame, kept in a ring so the last few
+ * seconds can be written out as Chrome trace event JSON when something
+ * janky happened. Open the file in chrome://tracing or ui.perfetto.dev.
+ *
+ * Disabled, a phase costs the branch in trace_begin() and trace_end(). */
+
+// about a minute of busy frames
+#define TRACE_EVENTS (64 * 1024)
+
+typedef struct {
+    // a string literal, only the pointer is kept
+    const char *name;
+    double start, duration;
+    // bytes the phase handled, 0 if that means nothing for it
+    ulong bytes;
+} JTermTraceEvent;
+
+typedef struct {
+    // NULL while disabled
+    JTermTraceEvent *events;
+    // total events recorded, events[next % TRACE_EVENTS] is the oldest
+    ulong next;
+    // timestamps in the file count from here
+    double origin;
+} JTermTrace;
+
+void trace_init(JTermTrace *t, bool enabled);
+void trace_free(JTermTrace *t);
+/* Write the events that ended in the last seconds, all of them if seconds
+ * is 0. False if path can't be written. */
+bool trace_dump(const JTermTrace *t, const char *path, double seconds);
+
+static inline bool trace_enabled(const JTermTrace *t) {
+    return t->events;
+}
+
+// Returns the start time to pass to trace_end().
+static inline double trace_begin(const JTermTrace *t) {
+    return t->events ? now_seconds() : 0;
+}
+
+static inline void trace_end(JTermTrace *t, const char *name, double start,
+                             ulong bytes) {
+    if (!t->events)
+        return;
+    t->events[t->next++ % TRACE_EVENTS] = (JTermTraceEvent){
+        .name = name,
+        .start = start,
+        .duration = now_seconds() - start,
+        .bytes = bytes,
+    };
+}
+
+#endif
@@ -0,0 +1,691 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "cells.h"
+#include "common.h"
+#include "parser.h"
+#include "record.h"
+#include "term.h"
+
+/* jterm-bench: runs synthetic terminal output through the core without a
+ * window and reports throughput per stage.
+ *
+ *   ./jterm-bench [--json|--verify] [workload|file...]
+ *
+ * Every stage reports MB/s and ns/byte. cells, the only one that works a
+ * frame at a time, also reports the frames per second it drew, counting
+ * its cells_update() calls of FRAME_BYTES of output each.
+ *
+ *   parser   the parser alone, every callback a no-op
+ *   term     parser, grid and scrollback, what ingest costs
+ *   cells    term plus the renderer's instances, a frame at a time
+ *   chunkN   term fed N bytes per call
+ *
+ * The 1 GB/s plain ASCII target is for the term stage, and it is missed on
+ * scrolling output: "ascii" ingests at about 380 MB/s here against 1.2
+ * GB/s for "redraw", where nothing scrolls. Every line that leaves the
+ * screen is still copied into the scrollback's hot lines and its row
+ * blanked for reuse; the row end bound and the SSE2 packing only keep that
+ * to the cells that were written. --json prints the same as one JSON
+ * object on stdout for comparing runs by script.
+ *
+ * Before timing, every workload is fed whole and in chunks of 1, 7, 1024
+ * and 64K bytes, and the resulting terminals must match. --verify runs
+ * only that check, prints a line per workload and exits with status 1 on
+ * the first mismatch, 0 when all match; build.sh test runs it.
+ *
+ * A file argument is benchmarked as raw PTY output, or if it is a session
+ * recording, as the output it recorded.
+ * "many-styles" prints three times STYLE_MAX differently coloured lines
+ * and checks every one still has its colour; --verify runs it too.
+ * "disk-history" pushes 10 million lines through a terminal with on-disk
+ * scrollback and checks that resident memory stays flat.
+ */
+
+#define STREAM_SIZE (32 * 1024 * 1024)
+#define MIN_SECONDS 0.5
+#define BENCH_W 400
+#define BENCH_H 200
+// what jterm-headless and the PTY ring hand out per frame by default
+#define FRAME_BYTES (64 * 1024)
+
+typedef struct {
+    uchar *data;
+    size_t len, cap;
+} Stream;
+
+static void put(Stream *s, const char *fmt, ...) {
+    char tmp[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+
+    if (s->len + n > s->cap) {
+        s->cap = MAX(s->cap * 2, s->len + n);
+        s->data = realloc(s->data, s->cap);
+    }
+    memcpy(&s->data[s->len], tmp, n);
+    s->len += n;
+}
+
+static const char *words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+    "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+//---Workloads---
+static void gen_ascii(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        put(s, "%s ", words[i % WORD_COUNT]);
+        if (i % 16 == 15)
+            put(s, "\r\n");
+    }
+}
+
+static void gen_sgr(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        put(s, "\x1b[%um%s\x1b[0m ", 31 + i % 7, words[i % WORD_COUNT]);
+        if (i % 16 == 15)
+            put(s, "\r\n");
+    }
+}
+
+/* Colour-heavy output like ls --color, compiler diagnostics and truecolor
+ * prompts: bold and italic, 256-colour and RGB, a style change per word. */
+static void gen_color(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        switch (i % 4) {
+        case 0:
+            put(s, "\x1b[1;38;5;%um%s\x1b[0m ", i % 256, words[i % WORD_COUNT]);
+            break;
+        case 1:
+            put(s, "\x1b[3;38;2;%u;%u;%um%s\x1b[23m ", i % 256, i / 7 % 256,
+                255 - i % 256, words[i % WORD_COUNT]);
+            break;
+        case 2:
+            put(s, "\x1b[48;5;%u;4m%s\x1b[24;49m ", 232 + i % 24,
+                words[i % WORD_COUNT]);
+            break;
+        default:
+            put(s, "\x1b[0m%s ", words[i % WORD_COUNT]);
+            break;
+        }
+        if (i % 16 == 15)
+            put(s, "\r\n");
+    }
+}
+
+static void gen_cursor(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++)
+        put(s, "\x1b[%u;%uH%s", 1 + i % BENCH_H, 1 + (i * 7) % BENCH_W,
+            words[i % WORD_COUNT]);
+}
+
+// full-screen repaints row by row, like htop or vim redrawing
+static void gen_redraw(Stream *s) {
+    for (uint frame = 0; s->len < STREAM_SIZE; frame++) {
+        put(s, "\x1b[H");
+        for (uint y = 1; y <= BENCH_H; y++) {
+            put(s, "\x1b[%u;1H\x1b[%u;%um%5u", y, 30 + (y + frame) % 8,
+                40 + y % 8, frame * BENCH_H + y);
+            put(s, "\x1b[0m");
+            for (uint x = 5; x < BENCH_W - 16; x += 16)
+                put(s, " %-15s", words[(x + y + frame) % WORD_COUNT]);
+        }
+    }
+}
+
+/* Screen edits the way curses applications do them: short rows ended by
+ * EL, cleared fields, inserted and deleted characters and lines. */
+static void gen_edit(Stream *s) {
+    for (uint frame = 0; s->len < STREAM_SIZE; frame++) {
+        for (uint y = 1; y <= BENCH_H; y++) {
+            put(s, "\x1b[%u;1H%s %u\x1b[K", y, words[(y + frame) % WORD_COUNT],
+                frame);
+            put(s, "\x1b[%u;40H\x1b[20X%s", y, words[y % WORD_COUNT]);
+            if (y % 4 == 0)
+                put(s, "\x1b[%u;10H\x1b[3@abc\x1b[2P", y);
+        }
+        put(s, "\x1b[%u;1H\x1b[5M\x1b[%u;1H\x1b[5L", 1 + frame % BENCH_H,
+            1 + frame * 7 % BENCH_H);
+        put(s, "\x1b[%u;1H\x1b[J", BENCH_H - 2);
+    }
+}
+
+static const char *unicode_words[] = {
+    "grüße", "naïve", "façade", "日本語", "テキスト", "Ελληνικά", "кириллица",
+    "→", "✓", "λx.x", "∑∞", "한국어",
+};
+#define UNICODE_COUNT (sizeof(unicode_words) / sizeof(unicode_words[0]))
+
+static void gen_unicode(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        put(s, "%s ", unicode_words[i % UNICODE_COUNT]);
+        if (i % 16 == 15)
+            put(s, "\r\n");
+    }
+}
+
+// lines much longer than the screen is wide, minified JSON or a log blob
+static void gen_wrap(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        put(s, "%s", words[i % WORD_COUNT]);
+        if (i % 2000 == 1999)
+            put(s, "\r\n");
+    }
+}
+
+/* Output scrolling inside a 50 line region in the middle of the screen
+ * with a status line below it, like a pager or an editor's split. */
+static void gen_region(Stream *s) {
+    put(s, "\x1b[76;125r");
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        put(s, "\x1b[125;1H%s %s %u\r\n", words[i % WORD_COUNT],
+            words[i / 3 % WORD_COUNT], i);
+        if (i % 64 == 63)
+            put(s, "\x1b[200;1H\x1b[7mline %u\x1b[0m", i);
+    }
+    put(s, "\x1b[r");
+}
+
+/* Paging through files with less: every visit to the alternate screen
+ * draws a page and a status line, then the shell prints a prompt line on
+ * the main screen. The switches themselves should be noise next to the
+ * page. */
+static void gen_alt(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        put(s, "\x1b[?1049h\x1b[H");
+        for (uint y = 1; y < BENCH_H; y++)
+            put(s, "%s %s\r\n", words[(i + y) % WORD_COUNT],
+                words[y % WORD_COUNT]);
+        put(s, "\x1b[7m%s (END)\x1b[0m\x1b[?1049l$ less %s\r\n",
+            words[i % WORD_COUNT], words[i / 3 % WORD_COUNT]);
+    }
+}
+
+/* Truecolor rainbows like lolcat, a new pen every few characters. What
+ * the screen and recent history show stays well under STYLE_MAX pens, the
+ * stream as a whole has many times that. */
+static void gen_gradient(Stream *s) {
+    for (uint i = 0; s->len < STREAM_SIZE; i++) {
+        put(s, "\x1b[38;2;%u;%u;%um%.4s", i >> 16 & 0xFF, i >> 8 & 0xFF,
+            i & 0xFF, words[i / 4 % WORD_COUNT]);
+        if (i % 20 == 19)
+            put(s, "\x1b[0m\r\n");
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*gen)(Stream *s);
+} Workload;
+
+static const Workload workloads[] = {
+    {"ascii", gen_ascii},     {"sgr", gen_sgr},         {"color", gen_color},
+    {"cursor", gen_cursor},   {"redraw", gen_redraw},   {"edit", gen_edit},
+    {"unicode", gen_unicode}, {"wrap", gen_wrap},       {"region", gen_region},
+    {"alt", gen_alt},         {"gradient", gen_gradient},
+};
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+//---Stages---
+// written by every stage so the compiler can't drop their work
+static volatile ulong sink;
+
+static void null_print(void *user, uint cp) {
+    sink += cp;
+}
+
+static void null_print_run(void *user, const uchar *run, size_t n) {
+    sink += n;
+}
+
+static void null_execute(void *user, uchar c) {
+    sink += c;
+}
+
+static void null_csi(void *user, JTermParser *p, uchar final) {
+    sink += final + p->nparams;
+}
+
+static const JTermParserOps null_ops = {
+    .print = null_print,
+    .print_run = null_print_run,
+    .execute = null_execute,
+    .csi_dispatch = null_csi,
+};
+
+// parser only, every callback is a no-op
+static ulong stage_parser(const Stream *s, size_t chunk) {
+    JTermParser p;
+    parser_init(&p, &null_ops, NULL);
+    parser_feed(&p, s->data, s->len);
+    return 0;
+}
+
+// parser driving the grid, fed in chunks like the PTY ring hands them out
+static void feed_chunked(JTerm *t, const Stream *s, size_t chunk) {
+    for (size_t i = 0; i < s->len; i += chunk)
+        term_feed(t, &s->data[i], MIN(chunk, s->len - i));
+}
+
+static ulong stage_term(const Stream *s, size_t chunk) {
+    JTerm t;
+    term_init(&t, BENCH_W, BENCH_H);
+    feed_chunked(&t, s, chunk ? chunk : s->len);
+    term_free(&t);
+    return 0;
+}
+
+// a frame at a time and the instances the renderer would upload after each
+static ulong stage_cells(const Stream *s, size_t chunk) {
+    JTerm t;
+    JTermCells c;
+    ulong frames = 0;
+    term_init(&t, BENCH_W, BENCH_H);
+    cells_init(&c);
+    for (size_t i = 0; i < s->len; i += chunk) {
+        term_feed(&t, &s->data[i], MIN(chunk, s->len - i));
+        cells_update(&c, &t, 0);
+        sink += c.rebuilt;
+        frames++;
+    }
+    cells_free(&c);
+    term_free(&t);
+    return frames;
+}
+
+typedef struct {
+    const char *name;
+    // returns the frames it drew, 0 for stages that don't draw
+    ulong (*run)(const Stream *s, size_t chunk);
+    // bytes per feed call, 0 for the whole stream at once
+    size_t chunk;
+} Stage;
+
+static const Stage stages[] = {
+    {"parser", stage_parser},
+    {"term", stage_term},
+    {"cells", stage_cells, FRAME_BYTES},
+    {"chunk1", stage_term, 1},
+    {"chunk7", stage_term, 7},
+    {"chunk1k", stage_term, 1024},
+    {"chunk64k", stage_term, 64 * 1024},
+};
+#define STAGE_COUNT (sizeof(stages) / sizeof(stages[0]))
+
+static ulong term_hash(const JTerm *t) {
+    // FNV-1a over everything a reader of the grid can observe
+    ulong h = 0xcbf29ce484222325UL;
+#define HASH(v) h = (h ^ (v)) * 0x100000001b3UL
+    JTermGrid *g = (JTermGrid *)&t->grid;
+    for (uint y = 0; y < g->h; y++) {
+        for (uint x = 0; x < g->w; x++) {
+            HASH(grid_text(g, y)[x]);
+            HASH(grid_style(g, y)[x]);
+        }
+        HASH(*grid_flags(g, y) & ROW_WRAPPED);
+    }
+    HASH(scrollback_lines(&t->scrollback));
+    HASH(t->x);
+    HASH(t->y);
+    HASH(t->wrap_pending);
+    HASH(t->style);
+#undef HASH
+    return h;
+}
+
+/* The parser keeps its state between term_feed() calls, so splitting the
+ * stream anywhere, even inside a sequence, must not change the result. */
+static void verify_chunking(const char *name, const Stream *s) {
+    static const size_t chunks[] = {1, 7, 1024, 64 * 1024};
+    JTerm t;
+    ulong expected;
+
+    term_init(&t, BENCH_W, BENCH_H);
+    feed_chunked(&t, s, s->len);
+    expected = term_hash(&t);
+    term_free(&t);
+
+    for (uint i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        term_init(&t, BENCH_W, BENCH_H);
+        feed_chunked(&t, s, chunks[i]);
+        if (term_hash(&t) != expected) {
+            ERROR("%s: grid differs when fed in %zu byte chunks", name,
+                  chunks[i]);
+        }
+        term_free(&t);
+    }
+}
+
+static bool json;
+// --verify: only check chunking, time nothing
+static bool verify_only;
+// separates the objects in --json output
+static const char *json_sep = "";
+
+// What history costs per line for this kind of output.
+static void report_scrollback(const char *name, const Stream *s) {
+    JTerm t;
+    JTermScrollbackStats st;
+
+    term_init(&t, BENCH_W, BENCH_H);
+    scrollback_set_budget(&t.scrollback, (size_t)-1);
+    feed_chunked(&t, s, s->len);
+    scrollback_stats(&t.scrollback, &st);
+    term_free(&t);
+
+    ulong cold = st.lines - st.hot_lines;
+    double hot_per_line = st.hot_lines ? (double)st.hot_bytes / st.hot_lines
+                                       : 0.0;
+    double cold_per_line = cold ? (double)st.cold_bytes / cold : 0.0;
+    double ratio = st.cold_bytes ? (double)st.raw_bytes / st.cold_bytes : 0.0;
+    if (json) {
+        printf("\"history\": {\"lines\": %lu, \"hot_bytes_per_line\": %.1f, "
+               "\"cold_bytes_per_line\": %.1f, \"rle_ratio\": %.2f}, ",
+               st.lines, hot_per_line, cold_per_line, ratio);
+        return;
+    }
+    if (!st.lines)
+        return;
+    printf("%-10s %-8s %9lu lines %6.1f B/line hot %6.1f B/line cold "
+           "(%.1fx rle)\n",
+           name, "history", st.lines, hot_per_line, cold_per_line, ratio);
+}
+
+static void bench(const char *name, Stream s) {
+    verify_chunking(name, &s);
+    if (verify_only) {
+        printf("%-10s same grid at every chunk size\n", name);
+        free(s.data);
+        return;
+    }
+    if (json) {
+        printf("%s\n    {\"workload\": \"", json_sep);
+        // workload names are ours, files are paths: escape what JSON needs
+        for (const char *c = name; *c; c++)
+            printf(*c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+        printf("\", \"bytes\": %zu, ", s.len);
+        json_sep = ",";
+    }
+    report_scrollback(name, &s);
+
+    if (json)
+        printf("\"stages\": [");
+    for (uint i = 0; i < STAGE_COUNT; i++) {
+        // an empty file has no rate, and would spin for MIN_SECONDS
+        if (!s.len) {
+            if (json)
+                printf("%s\n        {\"stage\": \"%s\", \"mb_per_s\": null, "
+                       "\"ns_per_byte\": null, \"frames_per_s\": null}",
+                       i ? "," : "", stages[i].name);
+            else
+                printf("%-10s %-8s no output to run\n", name, stages[i].name);
+            continue;
+        }
+
+        ulong bytes = 0, frames = 0;
+        double start = now_seconds(), elapsed;
+        do {
+            frames += stages[i].run(&s, stages[i].chunk);
+            bytes += s.len;
+            elapsed = now_seconds() - start;
+        } while (elapsed < MIN_SECONDS);
+
+        double mbps = bytes / elapsed / (1024.0 * 1024.0);
+        double ns = elapsed * 1e9 / bytes;
+        double fps = frames / elapsed;
+        if (json) {
+            printf("%s\n        {\"stage\": \"%s\", \"mb_per_s\": %.2f, "
+                   "\"ns_per_byte\": %.3f, \"frames_per_s\": ",
+                   i ? "," : "", stages[i].name, mbps, ns);
+            printf(frames ? "%.1f}" : "null}", fps);
+        } else if (frames) {
+            printf("%-10s %-8s %9.1f MB/s %8.2f ns/byte %9.1f frames/s\n",
+                   name, stages[i].name, mbps, ns, fps);
+        } else {
+            printf("%-10s %-8s %9.1f MB/s %8.2f ns/byte\n", name,
+                   stages[i].name, mbps, ns);
+        }
+    }
+    if (json)
+        printf("]}");
+    free(s.data);
+}
+
+//---On-disk history---
+#define HISTORY_LINES 10000000UL
+#define HISTORY_BUDGET (4 * 1024 * 1024)
+#define HISTORY_PROBES 10000
+
+static long max_rss_kb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static ulong line_number(const JTermLine *l) {
+    char digits[32];
+    uint n = 0;
+    for (uint x = 5; x < l->len && n < sizeof(digits) - 1; x++) {
+        if (l->text[x] < '0' || l->text[x] > '9')
+            break;
+        digits[n++] = l->text[x];
+    }
+    digits[n] = '\0';
+    return strtoul(digits, NULL, 10);
+}
+
+static void disk_history() {
+    JTerm t;
+    JTermScrollbackStats st;
+    char buf[64 * 1024];
+    size_t len = 0;
+
+    term_init(&t, BENCH_W, BENCH_H);
+    scrollback_set_budget(&t.scrollback, HISTORY_BUDGET);
+    if (!scrollback_enable_disk(&t.scrollback, "/tmp")) {
+        ERROR("disk-history: can't create the scrollback file");
+    }
+
+    double start = now_seconds();
+    long rss_mid = 0;
+    ulong bytes = 0;
+    for (ulong i = 0; i < HISTORY_LINES; i++) {
+        if (len + 128 > sizeof(buf)) {
+            term_feed(&t, (uchar *)buf, len);
+            bytes += len;
+            len = 0;
+        }
+        len += snprintf(&buf[len], sizeof(buf) - len, "line %lu %s %s\r\n",
+                        i, words[i % WORD_COUNT], words[i / 7 % WORD_COUNT]);
+        if (i == HISTORY_LINES / 2)
+            rss_mid = max_rss_kb();
+    }
+    term_feed(&t, (uchar *)buf, len);
+    bytes += len;
+    double elapsed = now_seconds() - start;
+    long rss_end = max_rss_kb();
+
+    // every line must come back intact, newest first
+    ulong lines = scrollback_lines(&t.scrollback);
+    ulong newest = line_number(scrollback_line(&t.scrollback, 0));
+    start = now_seconds();
+    srand(1);
+    for (uint i = 0; i < HISTORY_PROBES; i++) {
+        ulong n = ((ulong)rand() * RAND_MAX + rand()) % lines;
+        if (line_number(scrollback_line(&t.scrollback, n)) != newest - n) {
+            ERROR("disk-history: line %lu came back wrong", n);
+        }
+    }
+    double probe = (now_seconds() - start) / HISTORY_PROBES;
+
+    scrollback_stats(&t.scrollback, &st);
+    printf("%-10s %lu lines in %.2fs (%.1f MB/s), %lu on disk in %.1f MB\n",
+           "disk-history", lines, elapsed, bytes / elapsed / (1024.0 * 1024.0),
+           st.disk_pages * SCROLLBACK_PAGE_LINES, st.disk_bytes / 1e6);
+    printf("%-10s max rss %ld KB at half way, %ld KB after ingest, "
+           "%.1f us per random line\n",
+           "disk-history", rss_mid, rss_end, probe * 1e6);
+    term_free(&t);
+}
+
+//---Many styles---
+// several times what the style table holds, a pen per line
+#define MANY_STYLES (3 * STYLE_MAX)
+#define MANY_STYLES_H 24
+
+// Line number i must be in the RGB colour i.
+static void check_colour(JTerm *t, const JTermLine *l, ulong want) {
+    ulong i = line_number(l);
+    const JTermLook *look = styles_look(&t->styles, l->style[0]);
+    uint rgb = look->fg[0] << 16 | look->fg[1] << 8 | look->fg[2];
+    if (i != want || rgb != (i & 0xFFFFFF)) {
+        ERROR("many-styles: line %lu is line %lu in colour %06X", want, i,
+              rgb);
+    }
+}
+
+/* Prints every line in an RGB colour of its own, far more than the style
+ * table holds at once, and checks that each comes back in its colour:
+ * on screen, in the hot scrollback and from packed pages. */
+static void many_styles() {
+    JTerm t;
+    char buf[64];
+
+    term_init(&t, 80, MANY_STYLES_H);
+    scrollback_set_budget(&t.scrollback, (size_t)-1);
+    double start = now_seconds();
+    for (uint i = 0; i < MANY_STYLES; i++) {
+        int n = snprintf(buf, sizeof(buf),
+                         "\x1b[38;2;%u;%u;%umline %u\x1b[0m\r\n",
+                         i >> 16 & 0xFF, i >> 8 & 0xFF, i & 0xFF, i);
+        term_feed(&t, (uchar *)buf, n);
+    }
+    double elapsed = now_seconds() - start;
+
+    // the last row is the empty one the cursor is on
+    for (uint y = 0; y < MANY_STYLES_H - 1; y++) {
+        JTermLine l = {
+            .text = grid_text(&t.grid, y),
+            .style = grid_style(&t.grid, y),
+            .len = t.grid.w,
+        };
+        check_colour(&t, &l, MANY_STYLES - (MANY_STYLES_H - 1) + y);
+    }
+    ulong lines = scrollback_lines(&t.scrollback);
+    if (lines != MANY_STYLES - (MANY_STYLES_H - 1)) {
+        ERROR("many-styles: %lu lines in scrollback", lines);
+    }
+    for (ulong n = 0; n < lines; n++)
+        check_colour(&t, scrollback_line(&t.scrollback, n), lines - 1 - n);
+    if (t.styles.full) {
+        ERROR("many-styles: new pens were drawn plain");
+    }
+
+    printf("%-10s %u pens, %lu collections of the style table, each line "
+           "in its colour (%.2fs)\n",
+           "many-styles", MANY_STYLES, t.styles.collections, elapsed);
+    term_free(&t);
+}
+
+static void append(Stream *s, const uchar *buf, size_t n) {
+    if (s->len + n > s->cap) {
+        s->cap = MAX(s->cap * 2, s->len + n);
+        s->data = realloc(s->data, s->cap);
+    }
+    memcpy(&s->data[s->len], buf, n);
+    s->len += n;
+}
+
+static bool load(Stream *s, const char *path) {
+    JTermReplay replay;
+    if (replay_open(&replay, path)) {
+        JTermRecord rec;
+        while (replay_next(&replay, &rec))
+            if (rec.type == RECORD_OUTPUT)
+                append(s, rec.data, rec.len);
+        replay_close(&replay);
+        return true;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    uchar buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        append(s, buf, n);
+    fclose(f);
+    return true;
+}
+
+static void run_workload(const Workload *w) {
+    Stream s = {0};
+    w->gen(&s);
+    bench(w->name, s);
+}
+
+int main(int argc, char *argv[]) {
+    int first = 1;
+    if (argc > 1 && !strcmp(argv[1], "--json")) {
+        json = true;
+        first = 2;
+        printf("{\"frame_bytes\": %d, \"results\": [", FRAME_BYTES);
+    } else if (argc > 1 && !strcmp(argv[1], "--verify")) {
+        verify_only = true;
+        first = 2;
+    } else {
+        printf("parser: parser alone, term: + grid and scrollback (the "
+               "1 GB/s ASCII target), cells: + instances\n");
+    }
+
+    if (argc <= first) {
+        for (uint i = 0; i < WORKLOAD_COUNT; i++)
+            run_workload(&workloads[i]);
+        if (verify_only)
+            many_styles();
+    }
+
+    for (int a = first; a < argc; a++) {
+        if (!strcmp(argv[a], "disk-history")) {
+            if (json || verify_only) {
+                ERROR("disk-history has no --json or --verify mode");
+            }
+            disk_history();
+            continue;
+        }
+        if (!strcmp(argv[a], "many-styles")) {
+            if (json) {
+                ERROR("many-styles has no --json output");
+            }
+            many_styles();
+            continue;
+        }
+
+        uint i;
+        for (i = 0; i < WORKLOAD_COUNT; i++) {
+            if (!strcmp(argv[a], workloads[i].name)) {
+                run_workload(&workloads[i]);
+                break;
+            }
+        }
+        if (i < WORKLOAD_COUNT)
+            continue;
+
+        Stream s = {0};
+        if (!load(&s, argv[a])) {
+            ERROR("no workload or file named %s", argv[a]);
+        }
+        bench(argv[a], s);
+    }
+
+    if (json)
+        printf("\n]}\n");
+    return 0;
+}
@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "cells.h"
+#include "common.h"
+#include "latency.h"
+#include "pty.h"
+#include "record.h"
+#include "term.h"
+#include "trace.h"
+
+/* jterm-headless: jterm without a window or a GPU.
+ *
+ *   ./jterm-headless [-s COLSxROWS] [-b BYTES] [-T TRACE] [-t] file...
+ *   ./jterm-headless [-s COLSxROWS] [-b BYTES] [-T TRACE] [-o FILE] [-k KEYS]
+ *                    -- command [args...]
+ *
+ * Files are raw PTY output or session recordings (JTERM_RECORD=file jterm,
+ * or -o here). A command runs on a PTY with the same reader thread and
+ * ring jterm uses for its shell. Either way the bytes go through the
+ * parser, the grid and the cell instances the renderer would upload, a
+ * frame's worth (at most BYTES) at a time, and it exits with timing
+ * statistics.
+ *
+ * Recordings replay as fast as possible, one frame per recorded chunk,
+ * which is the throughput benchmark. With -t they replay at the recorded
+ * speed and the report includes how far behind the recording each frame
+ * was ready, the latency benchmark.
+ *
+ * -k types KEYS keys into the command, one at a time once the previous one
+ * showed up, and reports the latency from key to echo and from echo to the
+ * end of the frame, as jterm does for real keys. The command has to echo,
+ * tools/input-latency.sh runs it against cat on a raw terminal.
+ *
+ * -T writes the frame phases as Chrome trace JSON, as JTERM_TRACE does
+ * for jterm.
+ */
+
+#define DEFAULT_W 160
+#define DEFAULT_H 50
+#define DEFAULT_FRAME_BYTES (64 * 1024)
+
+// -k: before the first key, so the command can set up its terminal
+#define KEY_SETTLE 0.2
+// from a key showing up to typing the next one
+#define KEY_INTERVAL 0.01
+// a key that doesn't echo in time ends the run
+#define KEY_TIMEOUT 1.0
+
+typedef struct {
+    JTerm term;
+    JTermCells cells;
+    size_t frame_bytes;
+
+    ulong bytes, frames;
+    ulong rebuilt, reused;
+    // time spent in term_feed() and in cells_update()
+    double feed, update;
+
+    // -t: replay at recorded speed and measure how late frames are
+    bool timed;
+    ulong late_frames;
+    double late, late_max;
+
+    // -o
+    JTermRecorder recorder;
+    // -T
+    JTermTrace trace;
+    // -k, keys left to type
+    ulong keys;
+    JTermLatency latency;
+} Headless;
+
+static void feed(Headless *h, const uchar *buf, size_t n) {
+    double start = now_seconds();
+    term_feed(&h->term, buf, n);
+    trace_end(&h->trace, "term_feed", start, n);
+    h->feed += now_seconds() - start;
+    h->bytes += n;
+}
+
+// what jterm does at the end of a frame before drawing
+static void end_frame(Headless *h) {
+    double start = now_seconds();
+    cells_update(&h->cells, &h->term, 0);
+    trace_end(&h->trace, "cells_update", start, 0);
+    h->update += now_seconds() - start;
+    h->rebuilt += h->cells.rebuilt;
+    h->reused += h->cells.reused;
+    h->frames++;
+}
+
+static void run_replay(Headless *h, JTermReplay *p) {
+    JTermRecord rec;
+
+    if (p->w != h->term.grid.w || p->h != h->term.grid.h)
+        term_resize(&h->term, p->w, p->h);
+
+    double start = now_seconds();
+    while (replay_next(p, &rec)) {
+        if (h->timed) {
+            double wait = start + rec.time - now_seconds();
+            if (wait > 0)
+                nanosleep(&(struct timespec){wait, (wait - (long)wait) * 1e9},
+                          NULL);
+        }
+
+        switch (rec.type) {
+        case RECORD_OUTPUT:
+            feed(h, rec.data, rec.len);
+            end_frame(h);
+            break;
+        case RECORD_RESIZE:
+            term_resize(&h->term, rec.w, rec.h);
+            break;
+        default:
+            // nothing is listening to input
+            continue;
+        }
+
+        if (h->timed) {
+            double late = now_seconds() - (start + rec.time);
+            h->late += late;
+            h->late_max = MAX(h->late_max, late);
+            h->late_frames++;
+        }
+    }
+}
+
+static void run_file(Headless *h, const char *path) {
+    JTermReplay replay;
+    if (replay_open(&replay, path)) {
+        run_replay(h, &replay);
+        replay_close(&replay);
+        return;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        ERROR("can't open %s", path);
+    }
+
+    uchar *buf = malloc(h->frame_bytes);
+    if (!buf) {
+        ERROR("out of memory");
+    }
+    ssize_t n;
+    while ((n = read(fd, buf, h->frame_bytes)) > 0) {
+        feed(h, buf, n);
+        end_frame(h);
+    }
+    if (n == -1) {
+        ERROR("read(%s)", path);
+    }
+    free(buf);
+    close(fd);
+}
+
+static void send_reply(void *user, const uchar *buf, size_t n) {
+    pt_queue_input(user, buf, n);
+}
+
+static void run_command(Headless *h, char *argv[]) {
+    PTY pty;
+    struct winsize ws = {
+        .ws_col = h->term.grid.w,
+        .ws_row = h->term.grid.h,
+    };
+
+    pt_pair(&pty);
+    if (ioctl(pty.master, TIOCSWINSZ, &ws) == -1) {
+        ERROR("ioctl(TIOCSWINSZ)");
+    }
+    pt_spawn(&pty, argv[0], argv);
+    pt_start_reader(&pty);
+    h->term.reply = send_reply;
+    h->term.reply_user = &pty;
+
+    bool typing = h->keys;
+    double next_key = now_seconds() + KEY_SETTLE;
+    while (!pt_finished(&pty)) {
+        int timeout = -1;
+        if (typing) {
+            double now = now_seconds();
+            if (h->latency.npending) {
+                if (now - h->latency.pending[0].key > KEY_TIMEOUT) {
+                    ERROR("no echo after %.1fs, does the command echo?",
+                          KEY_TIMEOUT);
+                }
+                timeout = KEY_TIMEOUT * 1e3;
+            } else if (!h->keys) {
+                // every key made it to a frame
+                break;
+            } else if (now >= next_key) {
+                uchar c = 'a' + h->keys-- % 26;
+                latency_key(&h->latency, now);
+                pt_queue_input(&pty, &c, 1);
+                timeout = KEY_TIMEOUT * 1e3;
+            } else {
+                timeout = (next_key - now) * 1e3 + 1;
+            }
+        }
+
+        // sleep like an idle jterm until the reader has something
+        bool flushed = pt_flush_input(&pty);
+        pt_arm_wakeup(&pty);
+        if (!ring_used(&pty.ring) &&
+            !__atomic_load_n(&pty.closed, __ATOMIC_ACQUIRE)) {
+            struct pollfd pfd[2] = {
+                {.fd = pty.wakeup[0], .events = POLLIN},
+                {.fd = pty.master, .events = POLLOUT},
+            };
+            if (poll(pfd, flushed ? 1 : 2, timeout) == -1 && errno != EINTR) {
+                ERROR("poll");
+            }
+        }
+
+        uchar *buf;
+        size_t n, left = h->frame_bytes;
+        while (left && (n = ring_read_span(&pty.ring, &buf)) > 0) {
+            n = MIN(n, left);
+            feed(h, buf, n);
+            record_output(&h->recorder, buf, n);
+            pt_consume(&pty, n);
+            left -= n;
+        }
+        if (left != h->frame_bytes) {
+            latency_output(&h->latency, now_seconds());
+            end_frame(h);
+            latency_present(&h->latency, now_seconds());
+            next_key = now_seconds() + KEY_INTERVAL;
+        }
+    }
+}
+
+static void report(const Headless *h, double wall) {
+    double mb = h->bytes / (1024.0 * 1024.0);
+    ulong frames = MAX(h->frames, 1);
+
+    printf("%-10s %lu bytes, %lu frames in %.3fs wall\n", "headless",
+           h->bytes, h->frames, wall);
+    printf("%-10s %-8s %9.1f MB/s %8.2f ns/byte\n", "headless", "feed",
+           h->feed ? mb / h->feed : 0.0,
+           h->bytes ? h->feed * 1e9 / h->bytes : 0.0);
+    printf("%-10s %-8s %9.1f us/frame %6.1f rows rebuilt %6.1f reused\n",
+           "headless", "cells", h->update * 1e6 / frames,
+           (double)h->rebuilt / frames, (double)h->reused / frames);
+    printf("%-10s %-8s %9.1f frames/s if nothing else ran\n", "headless",
+           "cpu", h->frames / MAX(h->feed + h->update, 1e-9));
+    JTermLatencyStats latency;
+    latency_stats(&h->latency, &latency);
+    if (latency.samples) {
+        printf("%-10s %-8s %9.1f us p50 %9.1f us p99 key to echo\n",
+               "headless", "input", latency.key_echo_p50 * 1e3,
+               latency.key_echo_p99 * 1e3);
+        printf("%-10s %-8s %9.1f us p50 %9.1f us p99 echo to frame\n",
+               "headless", "input", latency.echo_present_p50 * 1e3,
+               latency.echo_present_p99 * 1e3);
+    }
+    if (h->late_frames)
+        printf("%-10s %-8s %9.1f us mean %9.1f us max behind the recording\n",
+               "headless", "latency", h->late * 1e6 / h->late_frames,
+               h->late_max * 1e6);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [-s COLSxROWS] [-b BYTES] [-T TRACE] [-t] file...\n"
+            "       %s [-s COLSxROWS] [-b BYTES] [-T TRACE] [-o FILE] "
+            "[-k KEYS] -- command [args...]\n",
+            argv0, argv0);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    Headless h = {.frame_bytes = DEFAULT_FRAME_BYTES};
+    uint w = DEFAULT_W, rows = DEFAULT_H;
+    int opt;
+
+    const char *record = NULL, *trace = NULL;
+    while ((opt = getopt(argc, argv, "+s:b:to:T:k:")) != -1) {
+        switch (opt) {
+        case 's':
+            if (sscanf(optarg, "%ux%u", &w, &rows) != 2 || !w || !rows)
+                usage(argv[0]);
+            break;
+        case 'b':
+            h.frame_bytes = strtoul(optarg, NULL, 10);
+            if (!h.frame_bytes)
+                usage(argv[0]);
+            break;
+        case 't':
+            h.timed = true;
+            break;
+        case 'o':
+            record = optarg;
+            break;
+        case 'T':
+            trace = optarg;
+            break;
+        case 'k':
+            h.keys = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    term_init(&h.term, w, rows);
+    cells_init(&h.cells);
+    trace_init(&h.trace, trace);
+    latency_init(&h.latency);
+    if (record && !record_open(&h.recorder, record, w, rows)) {
+        ERROR("can't record to %s", record);
+    }
+
+    double start = now_seconds();
+    // getopt() leaves the "--" in front of a command
+    if (!strcmp(argv[optind - 1], "--")) {
+        run_command(&h, &argv[optind]);
+    } else {
+        for (int a = optind; a < argc; a++)
+            run_file(&h, argv[a]);
+    }
+    report(&h, now_seconds() - start);
+    record_close(&h.recorder);
+    if (trace && !trace_dump(&h.trace, trace, 0)) {
+        ERROR("can't write %s", trace);
+    }
+    trace_free(&h.trace);
+
+    cells_free(&h.cells);
+    term_free(&h.term);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Start N jterm windows, leave them idle and report the CPU they burn.
+#
+#   tools/idle-cpu.sh [jterm binary] [instances] [seconds]
+#
+# Run it once against a build from before a change and once after to
+# compare. Needs a running X server.
+#
+# Only the X11 loop sleeps while idle. On macOS sokol's display link still
+# calls frame() at the display rate, so an idle window there costs what it
+# did before. No before/after numbers have been taken with this script yet.
+
+BIN=${1:-./jterm}
+N=${2:-20}
+SECONDS_IDLE=${3:-60}
+# let the shells start and print their prompt before measuring
+SETTLE=${SETTLE:-5}
+
+TICKS=$(getconf CLK_TCK)
+PIDS=""
+
+cleanup() {
+    [ -n "$PIDS" ] && kill $PIDS 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+# utime + stime of every instance, in clock ticks
+ticks() {
+    total=0
+    for pid in $PIDS; do
+        # the command name may contain spaces, fields count from the ')'
+        t=$(sed 's/.*) //' /proc/$pid/stat | awk '{print $12 + $13}')
+        total=$((total + ${t:-0}))
+    done
+    echo $total
+}
+
+i=0
+while [ $i -lt $N ]; do
+    "$BIN" >/dev/null 2>&1 &
+    PIDS="$PIDS $!"
+    i=$((i + 1))
+done
+
+sleep $SETTLE
+start=$(ticks)
+sleep $SECONDS_IDLE
+end=$(ticks)
+
+# percent of one core, summed over all instances
+awk -v t=$((end - start)) -v hz=$TICKS -v s=$SECONDS_IDLE -v n=$N 'BEGIN {
+    total = 100 * t / hz / s
+    printf "%d idle instances of '"$BIN"' for %ds: %.1f%% CPU total, %.2f%% each\n",
+        n, s, total, total / n
+}'
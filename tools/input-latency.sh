@@ -0,0 +1,13 @@
+#!/bin/sh
+# Type keys into a program that echoes them and report the latency from
+# key to echo and from echo to frame. No window or human needed, so it
+# can run in CI.
+#
+#   tools/input-latency.sh [jterm-headless binary] [keys]
+
+BIN=${1:-./jterm-headless}
+KEYS=${2:-200}
+
+# cat on a raw terminal echoes every key from userspace, like a shell's
+# line editor does, rather than the kernel echoing it
+exec "$BIN" -k "$KEYS" -- sh -c 'stty raw -echo && exec cat'